@@ -1,21 +1,89 @@
 #pragma once
 
+#include <cstddef>
 #include <type_traits>
+#include <utility>
+#include <functional>
 #include <atomic>
+#if __has_include(<compare>)
+#include <compare>
+#endif
+
+// ThreadSanitizer does not understand stand-alone fences
+#if defined(__SANITIZE_THREAD__)
+#define SHP_TSAN 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define SHP_TSAN 1
+#endif
+#endif
 
-#undef SHP_DEBUG
+// Cache-line size used to isolate contended data. We don't use
+// std::hardware_destructive_interference_size since its value may
+// differ between compiler flags (gcc warns about its use in headers
+// for that reason).
+#ifndef SHP_CACHELINE_SIZE
+#define SHP_CACHELINE_SIZE 64
+#endif
+
+// Type of ShpBase's reference count; e.g., 'short' (for tiny objects
+// with few references) or 'long long'. Like all such configuration
+// macros it must be defined consistently in all translation units.
+// ShpBaseT selects the type by a template parameter instead.
+// Overflow of the count is not checked.
+#ifndef SHP_REFCNT_TYPE
+#define SHP_REFCNT_TYPE int
+#endif
 
-#ifdef SHP_DEBUG
-#include <cstdio>
+// Tracepoints: Shp operations invoke
+//
+//   SHP_TRACE( event, ptr )
+//
+// where 'event' is a string literal (e.g., "Shp::~Shp") and 'ptr'
+// the managed object (which must not be dereferenced; it may have
+// been released already). The default expands to nothing; define
+// SHP_TRACE (consistently in all translation units) before including
+// this header to hook up a tracer (e.g., a USDT probe or a logger).
+#ifndef SHP_TRACE
+#define SHP_TRACE( event, ptr ) do { } while ( 0 )
 #endif
 
 // Simple intrusive shared pointer; the control block 'ShpBase'
-// should be derived from by a managed object.
+// (or 'ShpBaseT') should be derived from by a managed object.
 
 namespace IntrusiveSmart {
 
+// Reference-counting policies; Shp<T> manipulates the count
+// by means of the policy 'T::ShpCountPolicy'. The default
+// (inherited from ShpBase) is 'ShpAtomicCount'. An object type
+// which is only ever referenced from a single thread may declare
+//
+//   typedef ShpPlainCount ShpCountPolicy;
+//
+// to avoid atomic read-modify-write operations.
+//
+// The policies operate on any control block (ShpBase or ShpBaseT);
+// they access its 'refcnt_' and call its 'release()' member once
+// the count drops to zero.
+struct ShpAtomicCount;
+struct ShpPlainCount;
+struct ShpWeakCount;
+struct ShpBiasedCount;
+
+// control block of a managed object
+template <typename T>
+const typename T::ShpControlBlock *
+shpControlBlock(const T *p)
+{
+	return p;
+}
+
 class ShpBase {
 	template <typename T> friend class Shp;
+	friend struct ShpAtomicCount;
+	friend struct ShpPlainCount;
+	friend struct ShpWeakCount;
+	friend struct ShpBiasedCount;
 
 protected:
 
@@ -31,21 +99,41 @@ private:
 	// declare mutable; the reference-count is not conceptually
 	// 'part' of the 'real' object. We must manipulate it even
 	// in the case of a 'const' object.
-	mutable std::atomic<int> refcnt_{0};
+	// The same storage is used by all policies; a policy only
+	// determines how it is modified.
+	mutable std::atomic<SHP_REFCNT_TYPE> refcnt_{0};
 
-	int incRef() const {
-		return refcnt_.fetch_add(1);
+	// called by the policies once the count drops to zero
+	void release() const {
+		const_cast<ShpBase*>(this)->unmanage(Key());
 	}
 
-	int decRef() const {
-		int rv = refcnt_.fetch_sub(1);
-		if ( 1 == rv ) {
-			const_cast<ShpBase*>(this)->unmanage(Key());
-		}
-		return rv;
+public:
+	typedef ShpBase         ShpControlBlock;
+	typedef ShpAtomicCount  ShpCountPolicy;
+	typedef SHP_REFCNT_TYPE RefCnt;
+
+	// Immortal objects: a reserved bit of the count marks an
+	// object which is never unmanaged. Since every decrement is
+	// preceded by an increment the count (which starts at IMMORTAL)
+	// never drops to zero; the policies need not test for it.
+	// ShpImmortalCount skips the updates of immortal counts
+	// altogether (ShpBiasedCount doesn't support immortal objects).
+	// Mark the object before it is shared (e.g., right after
+	// construction); the number of ordinary references is limited
+	// to the bits below IMMORTAL.
+	static constexpr RefCnt IMMORTAL = RefCnt( RefCnt(1) << ( 8*sizeof(RefCnt) - 2 ) );
+
+	void makeImmortal() const
+	{
+		refcnt_.store( IMMORTAL, std::memory_order_relaxed );
+	}
+
+	bool isImmortal() const
+	{
+		return refcnt_.load( std::memory_order_relaxed ) & IMMORTAL;
 	}
 
-public:
 	// unmanage may be used to
 	//  - reset an object for reuse
 	//  - hand it over to an object manager, e.g., a free list.
@@ -54,13 +142,6 @@ public:
 	}
 
 public:
-#ifdef SHP_DEBUG
-	virtual void pr()
-	{
-		printf("refcnt %d\n", refcnt_.load());
-	}
-#endif
-
 	// for testing/debugging
 	long use_count() const
 	{
@@ -73,9 +154,213 @@ public:
 	}
 };
 
+// Memory ordering follows the conventional scheme (as used
+// by libstdc++ and boost::intrusive_ptr):
+//  - an increment may be relaxed; a new reference can only be
+//    created from an existing one, thus nothing must be ordered.
+//  - a decrement must 'release' so that all accesses to the
+//    object made via this reference happen before the object
+//    is unmanaged by whatever thread drops the count to zero.
+//  - that thread issues an 'acquire' fence before 'unmanage()'
+//    to synchronize with all those decrements (under TSan an
+//    equivalent acquire-load is used instead).
+// Immortal objects need no test: their count never drops to zero
+// (see ShpBase::IMMORTAL) but it is updated like any other count.
+//
+// The overloads taking a count 'n' add/drop 'n' references with a
+// single read-modify-write (e.g., used by AtomicShp); policies may
+// but need not provide them.
+struct ShpAtomicCount {
+	template <typename T>
+	static void incRef(const T *p, unsigned n = 1)
+	{
+		auto &c = shpControlBlock( p )->refcnt_;
+		c.fetch_add( decltype( c.load() )( n ), std::memory_order_relaxed );
+	}
+
+	template <typename T>
+	static void decRef(const T *p, unsigned n = 1)
+	{
+		auto  b = shpControlBlock( p );
+		auto &c = b->refcnt_;
+		if ( decltype( c.load() )( n ) == c.fetch_sub( decltype( c.load() )( n ), std::memory_order_release ) ) {
+#ifdef SHP_TSAN
+			c.load( std::memory_order_acquire );
+#else
+			std::atomic_thread_fence( std::memory_order_acquire );
+#endif
+			b->release();
+		}
+	}
+};
+
+// Like ShpAtomicCount but the counts of immortal objects are not
+// modified at all: copies of references to them don't write to the
+// object and the object may be shared by all cores without contention
+// (e.g., singletons, sentinels, static tables). The test costs a load
+// (of the line the read-modify-write accesses anyways) for every
+// update of every object; use this policy only for types which have
+// immortal instances:
+//
+//   struct Config : ShpBase { typedef ShpImmortalCount ShpCountPolicy; ... };
+struct ShpImmortalCount {
+	template <typename T>
+	static void incRef(const T *p, unsigned n = 1)
+	{
+		if ( ! shpControlBlock( p )->isImmortal() ) {
+			ShpAtomicCount::incRef( p, n );
+		}
+	}
+
+	template <typename T>
+	static void decRef(const T *p, unsigned n = 1)
+	{
+		if ( ! shpControlBlock( p )->isImmortal() ) {
+			ShpAtomicCount::decRef( p, n );
+		}
+	}
+};
+
+// Plain (non-atomic) increments/decrements for objects which
+// are confined to a single thread. Relaxed loads and stores
+// compile into ordinary memory accesses.
+struct ShpPlainCount {
+	template <typename T>
+	static void incRef(const T *p)
+	{
+		auto &c = shpControlBlock( p )->refcnt_;
+		c.store( c.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+	}
+
+	template <typename T>
+	static void decRef(const T *p)
+	{
+		auto  b = shpControlBlock( p );
+		auto &c = b->refcnt_;
+		auto  v = decltype( c.load() )( c.load( std::memory_order_relaxed ) - 1 );
+		c.store( v, std::memory_order_relaxed );
+		if ( 0 == v ) {
+			b->release();
+		}
+	}
+};
+
+// Release policy for ShpBaseT: delete the object
+struct ShpDeleteRelease {
+	template <typename T>
+	static void release(T *p)
+	{
+		delete p;
+	}
+};
+
+// Control block without any virtual methods (and thus without
+// a vtable pointer). The action to be taken once the last
+// reference is dropped is resolved at compile time:
+//
+//   Release::release( Derived * )
+//
+// is called and may be inlined into Shp's destructor.
+//
+// 'RefCnt' is the type of the reference count (e.g., a 16-bit
+// count and no vtable make for a two-byte control block).
+//
+// NOTE: the destructor is not virtual; 'Derived' must be
+//       the type of the complete object (unless 'Derived'
+//       itself declares a virtual destructor).
+template <typename Derived, typename Release = ShpDeleteRelease, typename Count = ShpAtomicCount, typename RefCnt_ = int>
+class ShpBaseT {
+	friend struct ShpAtomicCount;
+	friend struct ShpPlainCount;
+	friend struct ShpWeakCount;
+	friend struct ShpBiasedCount;
+
+private:
+	mutable std::atomic<RefCnt_> refcnt_{0};
+
+	void release() const {
+		Release::release( static_cast<Derived*>( const_cast<ShpBaseT*>( this ) ) );
+	}
+
+protected:
+	~ShpBaseT() = default;
+
+public:
+	typedef ShpBaseT ShpControlBlock;
+	typedef Count    ShpCountPolicy;
+	typedef RefCnt_  RefCnt;
+
+	// see ShpBase
+	static constexpr RefCnt IMMORTAL = RefCnt( RefCnt(1) << ( 8*sizeof(RefCnt) - 2 ) );
+
+	void makeImmortal() const
+	{
+		refcnt_.store( IMMORTAL, std::memory_order_relaxed );
+	}
+
+	bool isImmortal() const
+	{
+		return refcnt_.load( std::memory_order_relaxed ) & IMMORTAL;
+	}
+
+	// for testing/debugging
+	long use_count() const
+	{
+		return refcnt_.load();
+	}
+};
+
+// Cache-line isolated control block: 'Base' (ShpBase, ShpBaseT<...>,
+// FreeListNode, ...) is padded to a full cache line and the object is
+// cache-line aligned. The members of the derived (user) class thus
+// start on the next line and writes to them by the thread using the
+// object don't contend with reference-count updates by other threads
+// (nor vice versa).
+//
+//   struct Msg : ShpPaddedBase<FreeListNode> { ... };
+//
+// This costs up to one cache line per object; it pays off only for
+// objects which are shared among threads while being modified.
+template <typename Base = ShpBase>
+class alignas(SHP_CACHELINE_SIZE) ShpPaddedBase : public Base {
+private:
+	static constexpr std::size_t PAD = ( SHP_CACHELINE_SIZE - sizeof(Base) % SHP_CACHELINE_SIZE ) % SHP_CACHELINE_SIZE;
+
+	// explicit padding; the tail padding of a (non-POD) base
+	// may be reused for members of a derived class. Aligning
+	// the padding like 'Base' places it at 'sizeof(Base)'.
+	// If 'Base' already fills whole lines a single byte keeps
+	// the derived members off the tail padding (they then start
+	// right after it, on the line following 'Base').
+	struct alignas(alignof(Base)) Pad {
+		char c_[PAD ? PAD : 1];
+	} pad_;
+
+public:
+	using Base::Base;
+};
+
+// detect whether 'T' is a managed object
+template <typename T, typename = void>
+struct ShpIsManaged : std::false_type {};
+
+template <typename T>
+struct ShpIsManaged<T, std::void_t<typename T::ShpControlBlock, typename T::ShpCountPolicy> >
+: std::true_type {};
+
+// Tag for constructing a Shp which adopts an existing reference
+// (i.e., one which had previously been detach()ed) without
+// incrementing the count:
+//
+//   T *raw = shp.detach();  // e.g., store in C callback context
+//   ...
+//   Shp<T> shp( raw, ShpAdopt() );
+struct ShpAdopt {};
+
 template <typename T> class Shp {
-	static_assert( std::is_base_of<ShpBase, T>::value );
+	static_assert( ShpIsManaged<T>::value, "T must be derived from ShpBase or ShpBaseT" );
 	template <typename U> friend class Shp;
+	typedef typename T::ShpCountPolicy Count;
 	T *p_;
 public:
 	typedef T element_type;
@@ -85,16 +370,18 @@ public:
 	// construct a new shared pointer
 	Shp(T *p) : p_(p) {
 		if ( p_ ) {
-			p_->incRef();
+			Count::incRef( p_ );
 		}
-#ifdef SHP_DEBUG
-		printf("Shp(T*): %ld\n", use_count());
-#endif
+		SHP_TRACE( "Shp::Shp(T*)", p_ );
+	}
+
+	// take over a reference without incrementing the count
+	Shp(T *p, ShpAdopt) noexcept : p_(p) {
 	}
 
 	long use_count() const
 	{
-		return p_ ? p_->refcnt_.load() : 0;
+		return p_ ? p_->use_count() : 0;
 	}
 
 	T *
@@ -120,23 +407,19 @@ private:
 	: p_(rhs.get())
 	{
 		if ( p_ ) {
-			p_->incRef();
+			Count::incRef( p_ );
 		}
-#ifdef SHP_DEBUG
-		printf("Shp(const Shp<U> &)\n");
-#endif
+		SHP_TRACE( "Shp::Shp(const Shp&)", p_ );
 	}
 
 	// Same for the move constructor.
 	template <typename U>
-	Shp(Shp<U> &&rhs, struct dummy_tag)
+	Shp(Shp<U> &&rhs, struct dummy_tag) noexcept
 	{
 		// just take over from rhs; no need to adjust reference count
 		p_ = rhs.get();
 		rhs.p_ = nullptr;
-#ifdef SHP_DEBUG
-		printf("Shp(Shp&&): %ld - %ld\n", use_count(), rhs.use_count());
-#endif
+		SHP_TRACE( "Shp::Shp(Shp&&)", p_ );
 	}
 
 public:
@@ -152,32 +435,35 @@ public:
 	{
 	}
 
+	// NOTE: 'rhs' is an lvalue inside the constructor body;
+	//       it must be std::move()d or the copy-constructor
+	//       would be selected.
 	template <typename U>
-	Shp(Shp<U> &&rhs)
-	: Shp( rhs, dummy_tag() )
+	Shp(Shp<U> &&rhs) noexcept
+	: Shp( std::move( rhs ), dummy_tag() )
 	{
 	}
 
-	Shp(Shp &&rhs)
-	: Shp( rhs, dummy_tag() )
+	Shp(Shp &&rhs) noexcept
+	: Shp( std::move( rhs ), dummy_tag() )
 	{
 	}
 
 	template <typename U>
 	Shp & operator=(const Shp<U> &rhs)
 	{
-		// we can decrement 'this' right away - if both
-		// 'this' and 'rhs' reference the same object then
-		// 'this' cannot drop to zero even if we decrement first.
-		if ( p_ ) {
-			p_->decRef();
+		// increment first; if 'this' and 'rhs' are the same
+		// Shp then decrementing first could drop the count
+		// to zero.
+		T *p = rhs.get();
+		if ( p ) {
+			Count::incRef( p );
 		}
-		if ( (p_ = rhs.get()) ) {
-			p_->incRef();
+		if ( p_ ) {
+			Count::decRef( p_ );
 		}
-#ifdef SHP_DEBUG
-		printf("operator=(Shp&): %ld - %ld\n", use_count(), rhs.use_count());
-#endif
+		SHP_TRACE( "Shp::operator=(const Shp&)", p );
+		p_ = p;
 		return *this;
 	}
 
@@ -189,49 +475,49 @@ public:
 	}
 
 	template <typename U>
-	Shp & operator=(Shp<U> &&rhs)
+	Shp & operator=(Shp<U> &&rhs) noexcept
 	{
-		T *p;
-		// if 'this' and 'rhs' reference the same object
-		// then the count is at least 2 and can not drop
-		// to zero if we decrement first.
-		if ( p_ ) {
-			p_->decRef();
-		}
-		// just move over; no need to adjust the count
-		p_     = rhs.get();
-		rhs.p_ = nullptr;
-		
-#ifdef SHP_DEBUG
-		printf("operator=(Shp&&): %ld - %ld\n", use_count(), rhs.use_count());
-#endif
+		// just move over; no need to adjust the count.
+		// Our previous reference is dropped by the
+		// temporary (this also handles self-assignment).
+		Shp( std::move( rhs ), dummy_tag() ).swap( *this );
+		SHP_TRACE( "Shp::operator=(Shp&&)", p_ );
 		return *this;
 	}
 
-	Shp & operator=(Shp &&rhs)
+	Shp & operator=(Shp &&rhs) noexcept
 	{
-		return operator=<T>(rhs);
+		return operator=<T>( std::move( rhs ) );
 	}
 
 	~Shp()
 	{
+		SHP_TRACE( "Shp::~Shp", p_ );
 		if ( p_ ) {
-			p_->decRef();
+			Count::decRef( p_ );
 		}
-#ifdef SHP_DEBUG
-		printf("~Shp(): %ld\n", use_count());
-#endif
 	}
 
 	void reset()
 	{
+		SHP_TRACE( "Shp::reset", p_ );
 		if ( p_ ) {
-			p_->decRef();
+			Count::decRef( p_ );
 			p_ = nullptr;
 		}
 	}
 
-	void swap(Shp &rhs)
+	// relinquish ownership without decrementing the count;
+	// the reference must eventually be adopted by another
+	// Shp (see ShpAdopt) or the object will never be released.
+	T *detach() noexcept
+	{
+		T *p = p_;
+		p_   = nullptr;
+		return p;
+	}
+
+	void swap(Shp &rhs) noexcept
 	{
 		// reference counts don't change
 		auto tmp = rhs.p_;
@@ -254,25 +540,268 @@ public:
 		return *p_;
 	}
 
-#ifdef SHP_DEBUG
-	void pr() const
+};
+
+// create a new object managed by a Shp
+template <typename T, typename... Args>
+Shp<T>
+make_shp(Args&&... args)
+{
+	return Shp<T>( new T( std::forward<Args>( args )... ) );
+}
+
+// Casts (like std::static_pointer_cast & friends). The overloads
+// taking an rvalue transfer the reference from 'p' to the result
+// without touching the count:
+//
+//   Shp<Msg>  m = queue.pop();
+//   Shp<Ping> p = static_shp_cast<Ping>( std::move( m ) );
+//
+// A failed dynamic_shp_cast leaves 'p' unchanged.
+template <typename T, typename U>
+Shp<T>
+static_shp_cast(const Shp<U> &p)
+{
+	return Shp<T>( static_cast<T*>( p.get() ) );
+}
+
+template <typename T, typename U>
+Shp<T>
+static_shp_cast(Shp<U> &&p) noexcept
+{
+	return Shp<T>( static_cast<T*>( p.detach() ), ShpAdopt() );
+}
+
+template <typename T, typename U>
+Shp<T>
+dynamic_shp_cast(const Shp<U> &p)
+{
+	return Shp<T>( dynamic_cast<T*>( p.get() ) );
+}
+
+template <typename T, typename U>
+Shp<T>
+dynamic_shp_cast(Shp<U> &&p) noexcept
+{
+	T *q = dynamic_cast<T*>( p.get() );
+	if ( q ) {
+		p.detach();
+	}
+	return Shp<T>( q, ShpAdopt() );
+}
+
+template <typename T, typename U>
+Shp<T>
+const_shp_cast(const Shp<U> &p)
+{
+	return Shp<T>( const_cast<T*>( p.get() ) );
+}
+
+template <typename T, typename U>
+Shp<T>
+const_shp_cast(Shp<U> &&p) noexcept
+{
+	return Shp<T>( const_cast<T*>( p.detach() ), ShpAdopt() );
+}
+
+// detect whether 'T' provides a 'reinit(Args...)' hook which
+// re-initializes a recycled object (see FreeListBase::make()).
+template <typename Void, typename T, typename... Args>
+struct ShpHasReinitImpl : std::false_type {};
+
+template <typename T, typename... Args>
+struct ShpHasReinitImpl<std::void_t<decltype( std::declval<T&>().reinit( std::declval<Args>()... ) )>, T, Args...>
+: std::true_type {};
+
+template <typename T, typename... Args>
+struct ShpHasReinit : ShpHasReinitImpl<void, T, Args...> {};
+
+// Non-owning 'borrowed' reference; similar to what std::string_view
+// is for strings. Passing a ShpRef down a call chain costs no
+// reference-count traffic. The callee may explicitly promote
+// it to an owning Shp if it needs to retain the object.
+// A ShpRef must not outlive the Shp it was created from.
+template <typename T> class ShpRef {
+	T *p_;
+public:
+	typedef T element_type;
+
+	ShpRef() : p_(nullptr) {}
+
+	ShpRef(std::nullptr_t) : p_(nullptr) {}
+
+	template <typename U>
+	ShpRef(const Shp<U> &shp)
+	: p_( shp.get() )
+	{
+	}
+
+	template <typename U>
+	ShpRef(const ShpRef<U> &rhs)
+	: p_( rhs.get() )
 	{
-		printf("%p: %ld\n", p_, use_count());
 	}
-#endif
 
+	T *
+	get() const
+	{
+		return p_;
+	}
+
+	// promote to an owning pointer
+	Shp<T> own() const
+	{
+		return Shp<T>( p_ );
+	}
+
+	explicit operator Shp<T>() const
+	{
+		return own();
+	}
+
+	long use_count() const
+	{
+		return p_ ? p_->use_count() : 0;
+	}
+
+	explicit operator bool() const
+	{
+		return !!p_;
+	}
+
+	T *operator->() const
+	{
+		return p_;
+	}
+
+	T &operator*() const
+	{
+		return *p_;
+	}
 };
 
 template <typename L, typename R>
-static bool operator==(Shp<L> lhs, Shp<R> rhs)
+static bool operator==(const ShpRef<L> &lhs, const ShpRef<R> &rhs)
 {
 	return lhs.get() == rhs.get();
 }
 
 template <typename L, typename R>
-static bool operator!=(Shp<L> lhs, Shp<R> rhs)
+static bool operator!=(const ShpRef<L> &lhs, const ShpRef<R> &rhs)
 {
 	return lhs.get() != rhs.get();
 }
 
+// Comparison operators take their arguments by reference;
+// they must not cause any reference-count traffic.
+
+template <typename L, typename R>
+static bool operator==(const Shp<L> &lhs, const Shp<R> &rhs)
+{
+	return lhs.get() == rhs.get();
+}
+
+template <typename L, typename R>
+static bool operator!=(const Shp<L> &lhs, const Shp<R> &rhs)
+{
+	return lhs.get() != rhs.get();
+}
+
+template <typename L>
+static bool operator==(const Shp<L> &lhs, std::nullptr_t)
+{
+	return ! lhs.get();
+}
+
+template <typename R>
+static bool operator==(std::nullptr_t, const Shp<R> &rhs)
+{
+	return ! rhs.get();
+}
+
+template <typename L>
+static bool operator!=(const Shp<L> &lhs, std::nullptr_t)
+{
+	return !! lhs.get();
+}
+
+template <typename R>
+static bool operator!=(std::nullptr_t, const Shp<R> &rhs)
+{
+	return !! rhs.get();
+}
+
+template <typename L, typename R>
+static bool operator==(const Shp<L> &lhs, R *rhs)
+{
+	return lhs.get() == rhs;
+}
+
+template <typename L, typename R>
+static bool operator==(L *lhs, const Shp<R> &rhs)
+{
+	return lhs == rhs.get();
+}
+
+template <typename L, typename R>
+static bool operator!=(const Shp<L> &lhs, R *rhs)
+{
+	return lhs.get() != rhs;
+}
+
+template <typename L, typename R>
+static bool operator!=(L *lhs, const Shp<R> &rhs)
+{
+	return lhs != rhs.get();
+}
+
+// Ordering (by address) so that Shp may be used as a key
+// in ordered containers. std::less et al. provide a total
+// order even for unrelated pointers.
+#if defined(__cpp_impl_three_way_comparison) && defined(__cpp_lib_three_way_comparison)
+template <typename L, typename R>
+static std::strong_ordering operator<=>(const Shp<L> &lhs, const Shp<R> &rhs)
+{
+	return std::compare_three_way()( lhs.get(), rhs.get() );
+}
+#else
+template <typename L, typename R>
+static bool operator<(const Shp<L> &lhs, const Shp<R> &rhs)
+{
+	return std::less<>()( lhs.get(), rhs.get() );
+}
+
+template <typename L, typename R>
+static bool operator>(const Shp<L> &lhs, const Shp<R> &rhs)
+{
+	return std::greater<>()( lhs.get(), rhs.get() );
+}
+
+template <typename L, typename R>
+static bool operator<=(const Shp<L> &lhs, const Shp<R> &rhs)
+{
+	return std::less_equal<>()( lhs.get(), rhs.get() );
+}
+
+template <typename L, typename R>
+static bool operator>=(const Shp<L> &lhs, const Shp<R> &rhs)
+{
+	return std::greater_equal<>()( lhs.get(), rhs.get() );
+}
+#endif
+
 }; // namespace IntrusiveSmart
+
+// hash by address so that Shp may be used as a key in
+// unordered containers.
+namespace std {
+
+template <typename T>
+struct hash< IntrusiveSmart::Shp<T> > {
+	size_t operator()(const IntrusiveSmart::Shp<T> &p) const noexcept
+	{
+		return hash<T*>()( p.get() );
+	}
+};
+
+}; // namespace std
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <IntrusiveShp.hpp>
+
+// Atomically replaceable shared pointer.
+//
+// Readers obtain a snapshot (load()) without locks while a
+// writer concurrently replaces the pointer (store(), exchange(),
+// compare_exchange_*()).
+//
+// Implementation: split reference counting with a reservation.
+// While 'p' is stored the AtomicShp holds 1 + RESERVE references
+// to it. The shared word holds the pointer together with the
+// number of reserved references which have been handed out:
+//
+//  - a reader increments the word's count with a single CAS; it
+//    thus takes over one of the reserved references and does not
+//    touch the object's count. This is the only write to the
+//    shared word per load(). Once half of the reservation is used
+//    up the reader adds a new batch to the object's count (with
+//    one read-modify-write if the count policy supports it, see
+//    ShpAtomicCount) and subtracts it from the word.
+//  - a writer swaps in a new pointer (with zero count; the new
+//    object's reservation is added before) and drops the unused
+//    part of the old object's reservation.
+//
+// The word also carries a tag which is incremented by every
+// write so that a reader may not mistake a pointer which has
+// been replaced and stored again for the original one (ABA).
+//
+// The cost of a load() is thus one CAS on the shared word (it
+// is retried if other readers or a writer interfere); readers
+// still contend on the cache line of the word (but no longer
+// write it twice and no longer write the object's count).
+// Dropping the snapshot decrements the object's count as usual.
+//
+// NOTE: the shared word is two machine words wide; see
+//       FreeListLockFree for the platform requirements.
+//       The count policy of 'T' must be thread-safe. While
+//       stored, an object's use_count() includes the
+//       reservation.
+
+namespace IntrusiveSmart {
+
+template <typename T>
+class AtomicShp {
+private:
+	typedef typename T::ShpCountPolicy        Count;
+	typedef typename T::ShpControlBlock::RefCnt RefCnt;
+
+	// whether the count policy updates 'n' references at once
+	template <typename C, typename = void>
+	struct HasBulk : std::false_type {};
+
+	template <typename C>
+	struct HasBulk<C, std::void_t< decltype( C::incRef( std::declval<T*>(), 1U ) ),
+	                               decltype( C::decRef( std::declval<T*>(), 1U ) ) > >
+	: std::true_type {};
+
+	static constexpr bool     BULK     = HasBulk<Count>::value;
+	// well below the IMMORTAL bit of the count; a policy without
+	// bulk updates applies a reservation reference by reference.
+	static constexpr unsigned MAX_RES  = 1U << ( 8*sizeof(RefCnt) - 6 < 20 ? 8*sizeof(RefCnt) - 6 : 20 );
+	static constexpr unsigned RESERVE  = BULK || MAX_RES < 64 ? MAX_RES : 64;
+
+	struct alignas(2*sizeof(void*)) Word {
+		T        *ptr_;
+		uint32_t  cnt_;
+		uint32_t  tag_;
+	};
+
+	mutable std::atomic<Word> w_;
+
+	static void addRefs(T *p, unsigned n)
+	{
+		if constexpr ( BULK ) {
+			Count::incRef( p, n );
+		} else {
+			while ( n-- ) {
+				Count::incRef( p );
+			}
+		}
+	}
+
+	static void dropRefs(T *p, unsigned n)
+	{
+		if constexpr ( BULK ) {
+			Count::decRef( p, n );
+		} else {
+			while ( n-- ) {
+				Count::decRef( p );
+			}
+		}
+	}
+
+	// reserve references to an object about to be stored
+	static T *reserve(Shp<T> &p)
+	{
+		if ( p ) {
+			addRefs( p.get(), RESERVE );
+		}
+		return p.detach();
+	}
+
+	// drop the references still held by a word which has been
+	// replaced (its own and the unused reservation).
+	static void release(const Word &w)
+	{
+		if ( w.ptr_ ) {
+			dropRefs( w.ptr_, 1 + RESERVE - w.cnt_ );
+		}
+	}
+
+	// called by a reader holding a reference to 'p' which found
+	// (at least) half of the reservation used up; 'cur' is the
+	// word as updated by the reader.
+	void replenish(T *p, Word cur) const
+	{
+		const uint32_t tag = cur.tag_;
+		const uint32_t k   = cur.cnt_;
+		addRefs( p, k );
+		while ( cur.ptr_ == p && cur.tag_ == tag ) {
+			Word nxt = cur;
+			nxt.cnt_ -= cur.cnt_ < k ? cur.cnt_ : k;
+			// release: a writer which sees the reduced count also
+			// sees the references added above.
+			if ( w_.compare_exchange_weak( cur, nxt,
+			                               std::memory_order_release,
+			                               std::memory_order_relaxed ) ) {
+				// another reader may have replenished concurrently
+				if ( cur.cnt_ - nxt.cnt_ < k ) {
+					dropRefs( p, k - ( cur.cnt_ - nxt.cnt_ ) );
+				}
+				return;
+			}
+		}
+		// replaced; the writer has accounted for all references
+		// handed out - ours are surplus.
+		dropRefs( p, k );
+	}
+
+public:
+	AtomicShp()
+	: w_( Word{ nullptr, 0, 0 } )
+	{
+	}
+
+	AtomicShp(Shp<T> p)
+	: w_( Word{ reserve( p ), 0, 0 } )
+	{
+	}
+
+	AtomicShp(const AtomicShp &)             = delete;
+	AtomicShp & operator=(const AtomicShp &) = delete;
+
+	bool is_lock_free() const
+	{
+		return w_.is_lock_free();
+	}
+
+	Shp<T> load() const
+	{
+		Word cur = w_.load( std::memory_order_relaxed );
+		Word acq;
+		do {
+			if ( ! cur.ptr_ ) {
+				return Shp<T>();
+			}
+			if ( cur.cnt_ >= RESERVE ) {
+				// exhausted; readers which found half of the
+				// reservation used up are replenishing it.
+				std::this_thread::yield();
+				cur = w_.load( std::memory_order_relaxed );
+				continue;
+			}
+			acq = cur;
+			++acq.cnt_;
+		} while ( ! w_.compare_exchange_weak( cur, acq,
+		                                      std::memory_order_acquire,
+		                                      std::memory_order_relaxed ) );
+		// we own one of the reserved references
+		if ( acq.cnt_ >= RESERVE / 2 ) {
+			replenish( acq.ptr_, acq );
+		}
+		return Shp<T>( acq.ptr_, ShpAdopt() );
+	}
+
+	Shp<T> exchange(Shp<T> desired)
+	{
+		Word cur = w_.load( std::memory_order_relaxed );
+		Word nxt { reserve( desired ), 0, 0 };
+		do {
+			nxt.tag_ = cur.tag_ + 1;
+		} while ( ! w_.compare_exchange_weak( cur, nxt,
+		                                      std::memory_order_acq_rel,
+		                                      std::memory_order_relaxed ) );
+		// the caller obtains the reference of the AtomicShp
+		if ( cur.ptr_ && RESERVE != cur.cnt_ ) {
+			dropRefs( cur.ptr_, RESERVE - cur.cnt_ );
+		}
+		return Shp<T>( cur.ptr_, ShpAdopt() );
+	}
+
+	void store(Shp<T> desired)
+	{
+		exchange( std::move( desired ) );
+	}
+
+	// Replace the pointer with 'desired' if it currently equals
+	// 'expected'. Otherwise 'expected' is updated with a snapshot
+	// of the current value.
+	bool compare_exchange_strong(Shp<T> &expected, Shp<T> desired)
+	{
+		Word cur = w_.load( std::memory_order_relaxed );
+		if ( cur.ptr_ == expected.get() ) {
+			T   *d = reserve( desired );
+			Word nxt;
+			do {
+				nxt = Word{ d, 0, cur.tag_ + 1 };
+				// may fail because the count changed; retry
+				if ( w_.compare_exchange_weak( cur, nxt,
+				                               std::memory_order_acq_rel,
+				                               std::memory_order_relaxed ) ) {
+					// 'expected' still holds a reference; the old
+					// object's count cannot drop to zero here.
+					release( cur );
+					return true;
+				}
+			} while ( cur.ptr_ == expected.get() );
+			// drop the reservation and the reference of 'desired'
+			release( Word{ d, 0, 0 } );
+		}
+		expected = load();
+		return false;
+	}
+
+	bool compare_exchange_weak(Shp<T> &expected, Shp<T> desired)
+	{
+		return compare_exchange_strong( expected, std::move( desired ) );
+	}
+
+	operator Shp<T>() const
+	{
+		return load();
+	}
+
+	AtomicShp & operator=(Shp<T> desired)
+	{
+		store( std::move( desired ) );
+		return *this;
+	}
+
+	~AtomicShp()
+	{
+		release( w_.load( std::memory_order_relaxed ) );
+	}
+};
+
+}; // namespace IntrusiveSmart
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <IntrusiveShp.hpp>
+
+// Biased reference counting (Choi et al., "Biased Reference
+// Counting: Minimizing Atomic Operations in Garbage Collection").
+//
+// Many objects are referenced (almost) exclusively by the thread
+// which obtained them. Biased counting is opt-in: derive from
+// ShpBiasedBase<Base> where 'Base' is the control block otherwise
+// used (ShpBase, FreeListNode, ...), e.g.,
+//
+//   struct Msg : ShpBiasedBase<FreeListNode> { ... };
+//
+// The thread which creates the first reference becomes the
+// object's 'owner'. The owner maintains a private, non-atomic
+// 'biased' count; i.e., copying and releasing an Shp amounts to
+// a plain increment/decrement. All other threads use the atomic
+// 'shared' count of the control block.
+//
+// Once the biased count drops to zero the owner gives up its
+// ownership and 'merges' the counts by setting a flag in the
+// shared count; from then on all threads use the shared count
+// and the object is released by whatever thread drops it to zero.
+//
+// The shared count becomes negative if the owner hands a reference
+// to another thread which drops it. That thread then 'queues' the
+// object to the owner which merges the counts the next time it
+// calls
+//
+//   ShpBiasedCount::merge();
+//
+// (e.g., from its event loop) or when it exits. Threads which
+// release references they got from other threads must thus call
+// merge() periodically; otherwise such objects are not recycled.
+//
+// NOTE: the strong references must be Shp's of the biased type (or
+//       types derived from it) and the policy is incompatible with
+//       ShpWeakBase. ShpBiasedBase::use_count() is exact only when
+//       called by the owner. Biased objects cannot be immortal.
+
+namespace IntrusiveSmart {
+
+template <typename Base = ShpBase>
+class ShpBiasedBase : public Base {
+	friend struct ShpBiasedCount;
+private:
+	// nullptr: no references (yet), MERGED: counts are merged,
+	// otherwise: token identifying the owner thread.
+	mutable std::atomic<const void *> owner_ {nullptr};
+	// accessed by the owner only
+	mutable int                       biased_{0};
+
+public:
+	typedef ShpBiasedBase  ShpBiasedControlBlock;
+	typedef ShpBiasedCount ShpCountPolicy;
+
+	using Base::Base;
+
+	long use_count() const;
+};
+
+// The shared count is held in the control block's 'refcnt_'; it
+// stores (count << 2) | queued-flag | merged-flag.
+struct ShpBiasedCount {
+private:
+	static constexpr int MERGED = 1;
+	static constexpr int QUEUED = 2;
+	static constexpr int ONE    = 4;
+
+	// objects which await merging by their owner
+	struct Queue {
+		typedef void (*Merge)(const void *);
+
+		std::mutex                                    mtx_;
+		std::vector< std::pair<const void *, Merge> > objs_;
+		bool                                          alive_ {true};
+	};
+
+	// per-thread queue; its address identifies the owner. The
+	// queue is never deleted since objects may still refer to it
+	// after the owner exited.
+	struct Owner {
+		Queue *q_ {new Queue()};
+
+		~Owner()
+		{
+			drain( q_, true );
+		}
+	};
+
+	static Queue *owner()
+	{
+		static thread_local Owner o;
+		return o.q_;
+	}
+
+	static const void *merged()
+	{
+		static const char tok = 0;
+		return &tok;
+	}
+
+	static void drain(Queue *q, bool exiting)
+	{
+		std::vector< std::pair<const void *, Queue::Merge> > objs;
+		while ( true ) {
+			{
+				std::unique_lock l( q->mtx_ );
+				objs.swap( q->objs_ );
+				if ( objs.empty() ) {
+					// objects queued after this point are merged
+					// by the queueing thread
+					q->alive_ = ! exiting;
+					return;
+				}
+			}
+			for ( auto &o : objs ) {
+				o.second( o.first );
+			}
+			objs.clear();
+		}
+	}
+
+	template <typename T>
+	static auto biased(const T *p)
+	{
+		return static_cast<const typename T::ShpBiasedControlBlock *>( p );
+	}
+
+	// reset for the next incarnation and release; the calling
+	// thread holds the only (conceptual) reference.
+	template <typename T>
+	static void release(const T *p)
+	{
+		auto b = shpControlBlock( p );
+		b->refcnt_.store( 0, std::memory_order_relaxed );
+		biased( p )->owner_.store( nullptr, std::memory_order_relaxed );
+		b->release();
+	}
+
+	// merge a queued object; executed by the owner (or by the
+	// queueing thread if the owner has exited)
+	template <typename T>
+	static void mergeQueued(const void *vp)
+	{
+		auto p     = static_cast<const T *>( vp );
+		auto c     = biased( p );
+		auto delta = decltype( shpControlBlock( p )->refcnt_.load() )( - QUEUED );
+		if ( c->owner_.load( std::memory_order_relaxed ) != merged() ) {
+			delta     += c->biased_ * ONE + MERGED;
+			c->biased_ = 0;
+			c->owner_.store( merged(), std::memory_order_relaxed );
+		}
+		if ( MERGED == shpControlBlock( p )->refcnt_.fetch_add( delta, std::memory_order_acq_rel ) + delta ) {
+			release( p );
+		}
+	}
+
+	template <typename T>
+	static void enqueue(Queue *q, const T *p)
+	{
+		{
+			std::unique_lock l( q->mtx_ );
+			if ( q->alive_ ) {
+				q->objs_.emplace_back( p, &mergeQueued<T> );
+				return;
+			}
+		}
+		mergeQueued<T>( p );
+	}
+
+public:
+	template <typename T>
+	static void incRef(const T *p)
+	{
+		auto        c = biased( p );
+		const void *o = c->owner_.load( std::memory_order_relaxed );
+		if ( o == owner() ) {
+			++c->biased_;
+		} else if ( ! o ) {
+			// first reference; nobody else can access the object
+			c->owner_.store( owner(), std::memory_order_relaxed );
+			c->biased_ = 1;
+		} else {
+			shpControlBlock( p )->refcnt_.fetch_add( ONE, std::memory_order_relaxed );
+		}
+	}
+
+	template <typename T>
+	static void decRef(const T *p)
+	{
+		auto        c = biased( p );
+		auto       &s = shpControlBlock( p )->refcnt_;
+		const void *o = c->owner_.load( std::memory_order_relaxed );
+		typedef decltype( s.load() ) V;
+		static_assert( std::is_signed<V>::value && sizeof(V) >= sizeof(int),
+		               "biased counting needs a signed count of at least 'int' width" );
+		if ( o == owner() ) {
+			if ( 0 == --c->biased_ ) {
+				c->owner_.store( merged(), std::memory_order_relaxed );
+				// release our accesses and acquire those of threads
+				// which dropped their references before the merge
+				if ( MERGED == ( s.fetch_or( MERGED, std::memory_order_acq_rel ) | MERGED ) ) {
+					release( p );
+				}
+			}
+			return;
+		}
+		V v = s.load( std::memory_order_relaxed );
+		V n;
+		do {
+			n = v - ONE;
+			if ( n < 0 && ! ( v & QUEUED ) ) {
+				n |= QUEUED;
+			}
+		} while ( ! s.compare_exchange_weak( v, n,
+		                                     std::memory_order_release,
+		                                     std::memory_order_relaxed ) );
+		if ( ( n & ~v ) & QUEUED ) {
+			// not merged; 'o' is the owner's queue
+			enqueue( static_cast<Queue *>( const_cast<void *>( o ) ), p );
+		} else if ( MERGED == n ) {
+#ifdef SHP_TSAN
+			s.load( std::memory_order_acquire );
+#else
+			std::atomic_thread_fence( std::memory_order_acquire );
+#endif
+			release( p );
+		}
+	}
+
+	// merge the objects queued to the calling thread
+	static void merge()
+	{
+		drain( owner(), false );
+	}
+
+	// token identifying the calling thread
+	static const void *self()
+	{
+		return owner();
+	}
+};
+
+template <typename Base>
+long
+ShpBiasedBase<Base>::use_count() const
+{
+	long n = Base::use_count() >> 2;
+	if ( owner_.load( std::memory_order_relaxed ) == ShpBiasedCount::self() ) {
+		n += biased_;
+	}
+	return n;
+}
+
+}; // namespace IntrusiveSmart
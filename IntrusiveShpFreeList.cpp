@@ -1,9 +1,21 @@
 
+#include <string>
+
 #include <IntrusiveShpFreeList.hpp>
 
 void
-IntrusiveSmart::FreeListNode::unmanage(const Key &)
+IntrusiveSmart::FreeListNode::unmanage(const Key &) noexcept( ! CHECKED )
 {
-	u_.list_->put( this );
+	FreeListBase *l = u_.list_.load( std::memory_order_relaxed );
+	SHP_TRACE( "FreeListNode::unmanage", this );
+	l->put( this );
 }
 
+void
+IntrusiveSmart::FreeListNode::checkFailed(const char *op) const
+{
+	auto n = use_count();
+	throw std::logic_error(
+		std::string( "FreeListNode::" ) + op + ": node " + ( n ? "is" : "is not" )
+		+ " managed by a Shp (use_count " + std::to_string( n ) + ")" );
+}
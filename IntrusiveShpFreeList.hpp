@@ -2,12 +2,53 @@
 
 #include <stdexcept>
 #include <mutex>
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#endif
 
 #include <IntrusiveShp.hpp>
+#include <IntrusiveShpFreeListStats.hpp>
 
 // Intrusive shared pointer for objects managed by
 // a free list.
 
+// Verify that the FreeListNode accessors are used in the proper
+// state (e.g., that a node is not referenced while it is linked
+// into a list); a violation throws std::logic_error. The checks
+// cost an atomic load each (under the list's lock) and are enabled
+// by default unless NDEBUG is defined. Without the checks the get
+// and put paths of the lists are noexcept. Note that a violation
+// detected while an object is released (i.e., in unmanage() called
+// from ~Shp) terminates the program. Define consistently in all
+// translation units.
+#ifndef SHP_FREELIST_CHECK
+#  ifdef NDEBUG
+#    define SHP_FREELIST_CHECK 0
+#  else
+#    define SHP_FREELIST_CHECK 1
+#  endif
+#endif
+
+// Layout of the free lists: if SHP_FREELIST_PADDED is nonzero the
+// contended members (e.g., the FreeListBase head and its lock, and
+// the counter of available objects) are placed on cache lines of
+// their own. This avoids false sharing between the lists' users but
+// makes every list a few cache lines large (the head of FreeListBase
+// is padded even if a subclass doesn't use it). Define consistently
+// in all translation units.
+#ifndef SHP_FREELIST_PADDED
+#define SHP_FREELIST_PADDED 0
+#endif
+
 namespace IntrusiveSmart {
 
 class FreeListBase;
@@ -26,67 +67,285 @@ private:
 	//   - while the object is not 'owned' by any Shp
 	//     the 'u_.next_' member is used for implementing
 	//     a linked list.
-	mutable union {
-		FreeListBase *list_;
-		FreeListNode *next_;
+	// The members are atomic because a lock-free list may
+	// read 'next_' speculatively while another thread
+	// already took the node over. All accesses use relaxed
+	// ordering which compiles to plain loads/stores.
+	mutable union U {
+		std::atomic<FreeListBase *> list_;
+		std::atomic<FreeListNode *> next_;
+		U() : next_(nullptr) {}
 	} u_;
 
 	// all the setters and getters for the pointer members
 	// must only be used while the object is not referenced
-	// by a Shp.
+	// by a Shp (list() only while it is).
+	// This is verified only if SHP_FREELIST_CHECK is nonzero
+	// (see above); otherwise the accessors are noexcept.
+	static constexpr bool CHECKED = SHP_FREELIST_CHECK;
 
-	FreeListNode *next() const
+	void check(bool managed, const char *op) const noexcept( ! CHECKED )
 	{
-		if ( use_count() ) {
-			throw std::bad_alloc();
+		if constexpr ( CHECKED ) {
+			if ( managed != !! use_count() ) {
+				checkFailed( op );
+			}
 		}
-		return u_.next_;
 	}
 
-	void setNext(FreeListNode *p) const
+	// throws std::logic_error
+	[[noreturn]] void checkFailed(const char *op) const;
+
+	FreeListNode *next() const noexcept( ! CHECKED )
 	{
-		if ( use_count() ) {
-			throw std::bad_alloc();
-		}
-		u_.next_ = p;
+		check( false, "next" );
+		return u_.next_.load( std::memory_order_relaxed );
 	}
 
-	void setList(FreeListBase *p) const
+	// read the 'next' pointer without checking; the result
+	// may be stale if the node is concurrently removed from
+	// a (lock-free) list.
+	FreeListNode *peekNext(std::memory_order o = std::memory_order_relaxed) const noexcept
 	{
-		if ( use_count() ) {
-			throw std::bad_alloc();
-		}
-		u_.list_ = p;
+		return u_.next_.load( o );
+	}
+
+	void setNext(FreeListNode *p) const noexcept( ! CHECKED )
+	{
+		check( false, "setNext" );
+		u_.next_.store( p, std::memory_order_relaxed );
+	}
+
+	void setList(FreeListBase *p) const noexcept( ! CHECKED )
+	{
+		check( false, "setList" );
+		u_.list_.store( p, std::memory_order_relaxed );
 	}
 
 protected:
 	// unmanage() returns the object to the associated free list
-	virtual void unmanage(const Key &) override;
+	virtual void unmanage(const Key &) noexcept( ! CHECKED ) override;
 
-	FreeListBase *list() const
+	FreeListBase *list() const noexcept( ! CHECKED )
 	{
-		if ( 0 == use_count() ) {
-			throw std::bad_alloc();
-		}
-		return u_.list_;
+		check( true, "list" );
+		return u_.list_.load( std::memory_order_relaxed );
 	}
 };
 
 // Base class for a free list holding FreeListNodes.
+//
+// With SHP_FREELIST_PADDED the list head (and its lock) and the
+// counter of available objects (which is also read outside of the
+// lock, e.g., by FreeListPool) live on separate cache lines.
 class FreeListBase {
+	friend class FreeListNode;
+protected:
+	// alignment of a contended member of type 'M' (its natural
+	// alignment unless SHP_FREELIST_PADDED is set)
+	template <typename M>
+	static constexpr std::size_t LINE_ALIGN = SHP_FREELIST_PADDED && SHP_CACHELINE_SIZE > alignof(M) ? SHP_CACHELINE_SIZE : alignof(M);
+
 private:
 
+	alignas(LINE_ALIGN<FreeListNode *>)
 	FreeListNode *anchor_ {nullptr};
 	std::mutex mtx_;
-	std::atomic<unsigned> avail_{0};
+
+	// threads blocked in get_wait()/get_for()
+	std::atomic<unsigned> waiters_{0};
+#ifndef __linux__
+	std::mutex              waitMtx_;
+	std::condition_variable waitCond_;
+#endif
+
+	typedef std::chrono::steady_clock Clock;
+
+	// block until 'avail_' is (possibly) no longer zero or the
+	// deadline expires; spurious wakeups are possible.
+	void waitAvail(Clock::time_point deadline)
+	{
+#ifdef __linux__
+		static_assert( sizeof(avail_) == sizeof(unsigned), "futex requires a plain 32-bit word" );
+		struct timespec  ts;
+		struct timespec *tsp = nullptr;
+		if ( deadline != Clock::time_point::max() ) {
+			auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>( deadline - Clock::now() ).count();
+			if ( ns <= 0 ) {
+				return;
+			}
+			ts.tv_sec  = ns / 1000000000;
+			ts.tv_nsec = ns % 1000000000;
+			tsp        = &ts;
+		}
+		syscall( SYS_futex, reinterpret_cast<unsigned *>( &avail_ ), FUTEX_WAIT_PRIVATE, 0, tsp, nullptr, 0 );
+#else
+		std::unique_lock l( waitMtx_ );
+		auto avail = [this] { return 0 != avail_.load(); };
+		if ( deadline == Clock::time_point::max() ) {
+			waitCond_.wait( l, avail );
+		} else {
+			waitCond_.wait_until( l, deadline, avail );
+		}
+#endif
+	}
+
+	FreeListNode *getUntil(Clock::time_point deadline)
+	{
+		FreeListNode *p = getRaw();
+		if ( ! p ) {
+			// announce ourselves before re-checking 'avail_'; pairs
+			// with the (seq_cst) increment of 'avail_' and load of
+			// 'waiters_' in wakeWaiters().
+			waiters_.fetch_add( 1 );
+			while ( ! ( p = getRaw() ) ) {
+				if ( avail_.load() ) {
+					// a 'put' is in progress
+					std::this_thread::yield();
+					continue;
+				}
+				if ( Clock::now() >= deadline ) {
+					break;
+				}
+				waitAvail( deadline );
+			}
+			waiters_.fetch_sub( 1 );
+		}
+		SHP_TRACE( "FreeListBase::getUntil", p );
+		stats_.get( !!p, avail() );
+		return p;
+	}
+
+public:
+	typedef void (*Destroy)(FreeListNode *);
+
+	// Whether nodes may be destroyed (i.e., their memory released)
+	// while other threads still use the list. This is false for
+	// lists which read nodes they do not own (FreeListLockFree);
+	// users such as FreeListPool or FreeListMagazine then never
+	// destroy nodes before the list itself is destroyed.
+	static constexpr bool SAFE_DESTROY = true;
+
+	// Whether getRaw(), putRaw(), getChainRaw() and putChainRaw() (and
+	// thus get(), put(), getChain(), putChain(), getN() and releasing
+	// an object) are noexcept. This
+	// holds for all lists unless SHP_FREELIST_CHECK is set; lists
+	// which grow on demand treat a failure to grow (e.g., an
+	// exception thrown by a factory) like an empty list.
+	static constexpr bool NOEXCEPT = ! FreeListNode::CHECKED;
 
 protected:
 
+	alignas(LINE_ALIGN<std::atomic<unsigned>>)
+	std::atomic<unsigned> avail_{0};
+
+	// see IntrusiveShpFreeListStats.hpp; subclasses record
+	// contention (gets and puts are counted by this class and
+	// by countPuts()).
+	FreeListStats         stats_;
+
+	// How nodes discarded by the list (e.g., when the list
+	// is destroyed) are released. This is a plain member
+	// rather than a virtual method so that a subclass'
+	// choice is still in effect while the base class
+	// destructors execute. A nullptr means that the nodes'
+	// storage is owned elsewhere (e.g., by a slab) and the
+	// lists must not touch them during destruction.
+	Destroy destroy_ { [](FreeListNode *p) { delete p; } };
+
+	// Whether make() may construct an object with 'new' when
+	// the list is empty. Lists which create their own objects
+	// (FreeListPool, FreeListSlabPool) grow in getRaw() and
+	// clear this: an object from the heap would bypass their
+	// factory and, if 'destroy_' is nullptr, never be deleted.
+	bool    makeNew_ { true };
+
+	// Subclasses must call this after making 'n' nodes available
+	// (i.e., after incrementing 'avail_' with seq_cst ordering);
+	// it is cheap unless there are waiters. At most 'n' waiters
+	// are woken.
+	void wakeWaiters(unsigned n)
+	{
+		unsigned w = waiters_.load();
+		if ( w && n ) {
+			if ( n > w ) {
+				n = w;
+			}
+#ifdef __linux__
+			syscall( SYS_futex, reinterpret_cast<unsigned *>( &avail_ ), FUTEX_WAKE_PRIVATE, int( n < INT_MAX ? n : INT_MAX ), nullptr, nullptr, 0 );
+#else
+			{
+				std::unique_lock l( waitMtx_ );
+			}
+			while ( n-- ) {
+				waitCond_.notify_one();
+			}
+#endif
+		}
+	}
+
+	// whether threads are blocked in get_wait()/get_for() (seq_cst).
+	// Lists which make nodes available lazily use this to publish
+	// them right away (see FreeListDeferred::put()).
+	bool hasWaiters() const
+	{
+		return !! waiters_.load();
+	}
+
+	// record 'n' objects which were made available without
+	// going through put()/putChain() (e.g., when growing).
+	void countPuts(unsigned n)
+	{
+		if ( n ) {
+			stats_.put( avail(), n );
+		}
+	}
+
+	// record 'n' attempts to get an object of which 'hits'
+	// succeeded (for batch operations).
+	void countGets(unsigned n, unsigned hits)
+	{
+		if constexpr ( FreeListStats::ENABLED ) {
+			for ( unsigned i = 0; i < n; ++i ) {
+				stats_.get( i < hits, avail() );
+			}
+		}
+	}
+
+	void destroy(FreeListNode *p)
+	{
+		if ( destroy_ ) {
+			destroy_( p );
+		}
+	}
+
+	// Accessors for subclasses which implement their
+	// own list (FreeListNode only befriends this class).
+	static FreeListNode *next(const FreeListNode *p) noexcept( ! FreeListNode::CHECKED )
+	{
+		return p->next();
+	}
+
+	static FreeListNode *peekNext(const FreeListNode *p, std::memory_order o = std::memory_order_relaxed) noexcept
+	{
+		return p->peekNext( o );
+	}
+
+	static void setNext(const FreeListNode *p, FreeListNode *n) noexcept( ! FreeListNode::CHECKED )
+	{
+		p->setNext( n );
+	}
+
+	static void setList(const FreeListNode *p, FreeListBase *l) noexcept( ! FreeListNode::CHECKED )
+	{
+		p->setList( l );
+	}
+
 	// Get head from the free-list as a plain/raw (non-shared)
 	// pointer.
-	virtual FreeListNode *getRaw()
+	virtual FreeListNode *getRaw() noexcept( NOEXCEPT )
 	{
-		std::unique_lock l( mtx_ );
+		auto l = stats_.lock( mtx_ );
 		auto rv = anchor_;
 		if ( rv ) {
 			anchor_ = rv->next();
@@ -96,17 +355,117 @@ protected:
 		return rv;
 	}
 
+	// Enqueue an object; put() counts it. Subclasses which
+	// delegate to their base class call its putRaw() so that
+	// the object is counted only once.
+	virtual void putRaw(FreeListNode *p) noexcept( NOEXCEPT )
+	{
+		{
+			auto l = stats_.lock( mtx_ );
+			p->setNext( anchor_ );
+			anchor_ = p;
+			avail_.fetch_add(1);
+		}
+		wakeWaiters( 1 );
+	}
+
+	// Enqueue a chain of 'count' nodes (see putChain()) in
+	// a single critical section.
+	virtual void putChainRaw(FreeListNode *head, FreeListNode *tail, unsigned count) noexcept( NOEXCEPT )
+	{
+		if ( ! head ) {
+			return;
+		}
+		{
+			auto l = stats_.lock( mtx_ );
+			tail->setNext( anchor_ );
+			anchor_ = head;
+			avail_.fetch_add( count );
+		}
+		wakeWaiters( count );
+	}
+
+	// Dequeue up to 'n' nodes in a single critical section.
+	// Returns the number of nodes obtained; the chain's head
+	// and tail are stored in *headp/*tailp (if non-null).
+	// getChain() counts them; subclasses which refill from
+	// their base class (e.g., FreeListMagazine) call this
+	// so that objects are counted only once (when they are
+	// handed out).
+	virtual unsigned getChainRaw(FreeListNode **headp, FreeListNode **tailp, unsigned n) noexcept( NOEXCEPT )
+	{
+		FreeListNode *head = nullptr;
+		FreeListNode *tail = nullptr;
+		unsigned      cnt  = 0;
+		{
+			auto l = stats_.lock( mtx_ );
+			head = anchor_;
+			while ( cnt < n && anchor_ ) {
+				tail    = anchor_;
+				anchor_ = anchor_->next();
+				++cnt;
+			}
+			avail_.fetch_sub( cnt );
+		}
+		if ( tail ) {
+			tail->setNext( nullptr );
+		} else {
+			head = nullptr;
+		}
+		if ( headp ) {
+			*headp = head;
+		}
+		if ( tailp ) {
+			*tailp = tail;
+		}
+		return cnt;
+	}
+
 public:
 	// Enqueue object on the free list.
 	// Note that new objects (as created with 'new'
 	// have a reference count of zero and may simply
 	// be added to the free list).
-	virtual void put(FreeListNode *p)
+	// NOTE: put(), putChain() and getChain() are not virtual
+	//       (they count the objects); subclasses customize
+	//       putRaw(), putChainRaw() and getChainRaw() instead.
+	void put(FreeListNode *p) noexcept( NOEXCEPT )
+	{
+		putRaw( p );
+		stats_.put( avail() );
+	}
+
+	// Batch operations; the chain of nodes is linked
+	// via their 'next' pointers. The nodes of a chain
+	// are not managed, i.e., have a zero reference count.
+
+	// Dequeue up to 'n' nodes (see getChainRaw()); the
+	// attempt is counted as 'n' gets.
+	unsigned getChain(FreeListNode **headp, FreeListNode **tailp, unsigned n) noexcept( NOEXCEPT )
 	{
-		std::unique_lock l( mtx_ );
-		p->setNext( anchor_ );
-		anchor_ = p;
-		avail_.fetch_add(1);
+		unsigned cnt = getChainRaw( headp, tailp, n );
+		countGets( n, cnt );
+		return cnt;
+	}
+
+	// Enqueue a chain of 'count' nodes in one go.
+	void putChain(FreeListNode *head, FreeListNode *tail, unsigned count) noexcept( NOEXCEPT )
+	{
+		putChainRaw( head, tail, count );
+		countPuts( head ? count : 0 );
+	}
+
+	// number of objects available on the list
+	unsigned avail() const
+	{
+		return avail_.load( std::memory_order_relaxed );
+	}
+
+	// snapshot of the statistics (all zero unless compiled
+	// with SHP_FREELIST_STATS)
+	FreeListStats::Snapshot stats() const
+	{
+		return stats_.snapshot( avail() );
 	}
 
 	virtual ~FreeListBase()
@@ -116,8 +475,10 @@ public:
 		// own destructor; since that one is executed
 		// first this classes' destructor may find
 		// the list already emptied.
-		while ( auto p = getRaw() ) {
-			delete p;
+		if ( destroy_ ) {
+			while ( auto p = getRaw() ) {
+				destroy( p );
+			}
 		}
 	}
 
@@ -125,11 +486,83 @@ public:
 	// from the list.
 	template <typename T>
 	Shp<T>
-	get()
+	get() noexcept( NOEXCEPT )
 	{
 		auto p = getRaw();
+		SHP_TRACE( "FreeListBase::get", p );
+		stats_.get( !!p, avail() );
 		return Shp<T>(static_cast<T*>( p ));
 	}
+
+	// like get() but block while the list is empty (e.g., to
+	// apply backpressure with a pool of fixed size).
+	template <typename T>
+	Shp<T>
+	get_wait()
+	{
+		return Shp<T>( static_cast<T*>( getUntil( Clock::time_point::max() ) ) );
+	}
+
+	// like get_wait() but give up (and return a null Shp) once
+	// 'timeout' has expired.
+	template <typename T, typename Rep, typename Period>
+	Shp<T>
+	get_for(const std::chrono::duration<Rep, Period> &timeout)
+	{
+		auto deadline = Clock::now() + std::chrono::ceil<Clock::duration>( timeout );
+		return Shp<T>( static_cast<T*>( getUntil( deadline ) ) );
+	}
+
+	// obtain an object initialized from 'args'. A recycled
+	// object is re-initialized by its 'reinit(args...)' member
+	// (which should preserve any internal storage, e.g., by
+	// assigning to strings and vectors). If the list is empty
+	// a new object is constructed (and later returned to this
+	// list) - unless the list creates its own objects (see
+	// 'makeNew_'); make() then returns a null Shp if the list
+	// failed to grow (like get()). Without arguments 'reinit'
+	// is optional.
+	template <typename T, typename... Args>
+	Shp<T>
+	make(Args&&... args)
+	{
+		static_assert( sizeof...(Args) == 0 || ShpHasReinit<T, Args...>::value,
+		               "T must provide reinit(Args...)" );
+		auto q = getRaw();
+		SHP_TRACE( "FreeListBase::make", q );
+		stats_.get( !!q, avail() );
+		if ( auto p = static_cast<T*>( q ) ) {
+			if constexpr ( ShpHasReinit<T, Args...>::value ) {
+				p->reinit( std::forward<Args>( args )... );
+			}
+			return Shp<T>( p );
+		}
+		if ( ! makeNew_ || ! destroy_ ) {
+			return Shp<T>();
+		}
+		auto p = new T( std::forward<Args>( args )... );
+		p->setList( this );
+		return Shp<T>( p );
+	}
+
+	// obtain up to 'n' shared pointer-managed objects
+	// in one go. Returns the number of objects stored
+	// in 'ps'.
+	template <typename T>
+	unsigned
+	getN(Shp<T> *ps, unsigned n) noexcept( NOEXCEPT )
+	{
+		FreeListNode *p;
+		unsigned      cnt = getChainRaw( &p, nullptr, n );
+		countGets( n, cnt );
+		for ( unsigned i = 0; i < cnt; ++i ) {
+			auto nxt = p->next();
+			p->setList( this );
+			ps[i] = Shp<T>( static_cast<T*>( p ) );
+			p     = nxt;
+		}
+		return cnt;
+	}
 };
 
 }; // namespace IntrusiveSmart
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+#include <IntrusiveShpFreeList.hpp>
+
+// Bounded free list for pools of fixed capacity: the available
+// nodes are held in a preallocated array of pointers (a LIFO stack)
+// rather than linked via their 'next' pointers.
+//
+// Popping a node thus doesn't load from the node itself (which is
+// likely cold) but from the (contiguous, likely cached) array; the
+// node's 'list' pointer is set once when the node is put. Batch
+// operations (getArray()/putArray()/getN()) copy ranges of pointers.
+//
+//   FreeListArray lst( 1024 );
+//   for ( int i = 0; i < 1024; ++i ) {
+//       lst.put( new MyObj() );
+//   }
+//
+// The list may be used under the layering templates which pass
+// the capacity on to their base, e.g.,
+//
+//   FreeListMagazine<FreeListArray>           mag( 32, true, 1024 );
+//   FreeListPool<MyObj, FreeListArray>        pool( factory, 0, 1, ~0U, true, 1024 );
+//
+// NOTE: the capacity is fixed at construction. Nodes which are put
+//       while the list is full are released by 'destroy_' (i.e.,
+//       deleted by default) - e.g., objects created by 'make()'
+//       while the list was empty. Under FreeListSlabPool (which
+//       sets 'destroy_' to nullptr) such nodes are merely dropped
+//       from circulation; they are destroyed with their slab when
+//       the pool is destroyed. The capacity should then hold all
+//       objects the pool may create.
+
+namespace IntrusiveSmart {
+
+class FreeListArray : public FreeListBase {
+private:
+	// see SHP_FREELIST_PADDED
+	alignas(LINE_ALIGN<std::mutex>)
+	std::mutex                       mtx_;
+	unsigned                         top_ {0};
+	const unsigned                   cap_;
+	std::unique_ptr<FreeListNode*[]> slots_;
+
+	// copy up to 'n' nodes from the array (uncounted)
+	unsigned take(FreeListNode **ps, unsigned n) noexcept( NOEXCEPT )
+	{
+		auto l = stats_.lock( mtx_ );
+		if ( n > top_ ) {
+			n = top_;
+		}
+		top_ -= n;
+		std::memcpy( ps, &slots_[ top_ ], n * sizeof( *ps ) );
+		avail_.fetch_sub( n, std::memory_order_relaxed );
+		return n;
+	}
+
+	// release nodes which did not fit (outside of the lock)
+	void discard(FreeListNode * const *ps, unsigned n)
+	{
+		for ( unsigned i = 0; i < n; ++i ) {
+			destroy( ps[i] );
+		}
+	}
+
+	// copy nodes to the array; nodes which don't fit are released
+	void store(FreeListNode * const *ps, unsigned n) noexcept( NOEXCEPT )
+	{
+		for ( unsigned i = 0; i < n; ++i ) {
+			setList( ps[i], this );
+		}
+		unsigned cnt;
+		{
+			auto l = stats_.lock( mtx_ );
+			cnt = cap_ - top_;
+			if ( n < cnt ) {
+				cnt = n;
+			}
+			std::memcpy( &slots_[ top_ ], ps, cnt * sizeof( *ps ) );
+			top_ += cnt;
+			avail_.fetch_add( cnt );
+		}
+		wakeWaiters( cnt );
+		discard( ps + cnt, n - cnt );
+	}
+
+protected:
+
+	virtual FreeListNode *getRaw() noexcept( NOEXCEPT ) override
+	{
+		auto l = stats_.lock( mtx_ );
+		if ( 0 == top_ ) {
+			return nullptr;
+		}
+		avail_.fetch_sub( 1, std::memory_order_relaxed );
+		return slots_[ --top_ ];
+	}
+
+	virtual void putRaw(FreeListNode *p) noexcept( NOEXCEPT ) override
+	{
+		store( &p, 1 );
+	}
+
+	// Nodes which do not fit are released (see above).
+	virtual void putChainRaw(FreeListNode *head, FreeListNode * /* tail */, unsigned /* count */) noexcept( NOEXCEPT ) override
+	{
+		if ( ! head ) {
+			return;
+		}
+		unsigned cnt = 0;
+		{
+			auto l = stats_.lock( mtx_ );
+			while ( head && top_ < cap_ ) {
+				auto nxt = next( head );
+				setList( head, this );
+				slots_[ top_++ ] = head;
+				head = nxt;
+				++cnt;
+			}
+			avail_.fetch_add( cnt );
+		}
+		wakeWaiters( cnt );
+		while ( head ) {
+			auto nxt = next( head );
+			destroy( head );
+			head = nxt;
+		}
+	}
+
+	// The chain interface (used, e.g., by FreeListMagazine) links
+	// the nodes and thus has to touch each of them.
+	virtual unsigned getChainRaw(FreeListNode **headp, FreeListNode **tailp, unsigned n) noexcept( NOEXCEPT ) override
+	{
+		FreeListNode *head = nullptr;
+		FreeListNode *tail = nullptr;
+		unsigned      cnt  = 0;
+		{
+			auto l = stats_.lock( mtx_ );
+			while ( cnt < n && top_ ) {
+				auto p = slots_[ --top_ ];
+				if ( tail ) {
+					setNext( tail, p );
+				} else {
+					head = p;
+				}
+				tail = p;
+				++cnt;
+			}
+			avail_.fetch_sub( cnt, std::memory_order_relaxed );
+		}
+		if ( tail ) {
+			setNext( tail, nullptr );
+		}
+		if ( headp ) {
+			*headp = head;
+		}
+		if ( tailp ) {
+			*tailp = tail;
+		}
+		return cnt;
+	}
+
+public:
+	FreeListArray(unsigned capacity)
+	: cap_  ( capacity ),
+	  slots_( new FreeListNode*[ capacity ] )
+	{
+	}
+
+	unsigned capacity() const
+	{
+		return cap_;
+	}
+
+	// Dequeue up to 'n' nodes into 'ps'; returns the number of
+	// nodes obtained. The nodes are ready to be managed (their
+	// 'list' pointer is set).
+	unsigned getArray(FreeListNode **ps, unsigned n) noexcept( NOEXCEPT )
+	{
+		unsigned cnt = take( ps, n );
+		countGets( n, cnt );
+		return cnt;
+	}
+
+	// Enqueue 'n' (unmanaged) nodes from 'ps'.
+	void putArray(FreeListNode * const *ps, unsigned n) noexcept( NOEXCEPT )
+	{
+		store( ps, n );
+		countPuts( n );
+	}
+
+	// like FreeListBase::getN() but copies the pointers (up to 64
+	// per critical section) rather than walking a chain.
+	template <typename T>
+	unsigned
+	getN(Shp<T> *ps, unsigned n) noexcept( NOEXCEPT )
+	{
+		FreeListNode *raw[64];
+		unsigned      cnt = 0;
+		while ( cnt < n ) {
+			unsigned chunk = n - cnt < 64 ? n - cnt : 64;
+			unsigned got   = take( raw, chunk );
+			countGets( chunk, got );
+			for ( unsigned i = 0; i < got; ++i ) {
+				ps[ cnt++ ] = Shp<T>( static_cast<T*>( raw[i] ) );
+			}
+			if ( got < chunk ) {
+				break;
+			}
+		}
+		return cnt;
+	}
+
+	virtual ~FreeListArray() override
+	{
+		// the base class destructor would only see its own
+		// (empty) list; drain ours here.
+		if ( destroy_ ) {
+			while ( auto p = getRaw() ) {
+				destroy( p );
+			}
+		}
+	}
+};
+
+}; // namespace IntrusiveSmart
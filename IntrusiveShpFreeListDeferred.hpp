@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <IntrusiveShpFreeList.hpp>
+
+// Deferred recycling: objects released by their last Shp are
+// not returned to the free list synchronously. Instead, put()
+// merely pushes them onto a lock-free retire stack (a single
+// CAS; no lock, no reset). flush() drains the retire stack,
+// resets the objects (optional hook) and returns them to the
+// underlying list 'Base' in a single batch.
+//
+// flush() may be called explicitly, by an (optional) background
+// thread which runs every 'period' and - on demand - when the
+// underlying list has run empty. If threads are blocked in
+// get_wait()/get_for() then put() flushes immediately.
+//
+// The 'reset' hook runs on the get/put paths (which are
+// noexcept unless SHP_FREELIST_CHECK is set) and must not
+// throw.
+
+namespace IntrusiveSmart {
+
+template <typename Base = FreeListBase>
+class FreeListDeferred : public Base {
+public:
+	typedef std::function<void(FreeListNode *)> Reset;
+
+private:
+	std::atomic<FreeListNode *> retired_ {nullptr};
+	Reset                       reset_;
+	std::mutex                  mtx_;
+	std::condition_variable     cond_;
+	bool                        stop_ {false};
+	std::thread                 reclaimer_;
+
+	void reclaim(std::chrono::milliseconds period)
+	{
+		std::unique_lock l( mtx_ );
+		while ( ! cond_.wait_for( l, period, [this] { return stop_; } ) ) {
+			l.unlock();
+			flush();
+			l.lock();
+		}
+	}
+
+protected:
+	virtual FreeListNode *getRaw() noexcept( FreeListBase::NOEXCEPT ) override
+	{
+		if ( auto p = Base::getRaw() ) {
+			return p;
+		}
+		return flush() ? Base::getRaw() : nullptr;
+	}
+
+	// retire an object; it becomes available after the next flush()
+	virtual void putRaw(FreeListNode *p) noexcept( FreeListBase::NOEXCEPT ) override
+	{
+		FreeListNode *head = retired_.load( std::memory_order_relaxed );
+		do {
+			FreeListBase::setNext( p, head );
+		} while ( ! retired_.compare_exchange_weak( head, p,
+		                                            std::memory_order_seq_cst,
+		                                            std::memory_order_relaxed ) );
+		// a waiter announces itself before (re-)trying getRaw(),
+		// i.e., flush(); either it finds 'p' or we see the waiter
+		// (all seq_cst).
+		if ( this->hasWaiters() ) {
+			flush();
+		}
+	}
+
+public:
+	// 'period == 0' means no background thread; any trailing
+	// arguments are passed to the constructor of 'Base'.
+	template <typename... BaseArgs>
+	FreeListDeferred(
+		Reset                     reset  = Reset(),
+		std::chrono::milliseconds period = std::chrono::milliseconds( 0 ),
+		BaseArgs&&...             baseArgs)
+	: Base  ( std::forward<BaseArgs>( baseArgs )... ),
+	  reset_( reset )
+	{
+		if ( period.count() > 0 ) {
+			reclaimer_ = std::thread( &FreeListDeferred::reclaim, this, period );
+		}
+	}
+
+	// recycle all retired objects; returns their number
+	unsigned flush()
+	{
+		FreeListNode *head = retired_.exchange( nullptr, std::memory_order_seq_cst );
+		FreeListNode *tail = nullptr;
+		unsigned      cnt  = 0;
+		for ( auto p = head; p; p = FreeListBase::next( p ) ) {
+			if ( reset_ ) {
+				reset_( p );
+			}
+			tail = p;
+			++cnt;
+		}
+		Base::putChainRaw( head, tail, cnt );
+		return cnt;
+	}
+
+	virtual ~FreeListDeferred() override
+	{
+		if ( reclaimer_.joinable() ) {
+			{
+				std::unique_lock l( mtx_ );
+				stop_ = true;
+			}
+			cond_.notify_one();
+			reclaimer_.join();
+		}
+		// hand everything to the base class which disposes of it
+		flush();
+	}
+};
+
+}; // namespace IntrusiveSmart
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+
+#include <IntrusiveShpFreeList.hpp>
+
+// Lock-free variant of the free list; a Treiber stack
+// built on the FreeListNode 'next' link.
+
+namespace IntrusiveSmart {
+
+// The head pointer is paired with a tag which is
+// incremented by every 'pop' operation. This protects
+// against the ABA problem (the head being popped and
+// pushed back by other threads while a 'pop' is in
+// progress).
+//
+// A 'pop' reads the 'next' pointer of the head node while other
+// threads may already have popped that very node; the node's memory
+// must thus remain valid for as long as the list is in use. Nodes
+// which ever were on the list must not be deleted before the list
+// is destroyed (see SAFE_DESTROY) - they can only be returned to it.
+//
+// NOTE: the tagged head is two words wide; whether the
+//       operations are truly lock-free depends on the
+//       platform providing a double-word CAS (e.g., on
+//       x86_64 compile with -mcx16; gcc routes these
+//       atomics through libatomic, i.e., link with -latomic).
+class FreeListLockFree : public FreeListBase {
+private:
+
+	struct alignas(2*sizeof(void*)) Head {
+		FreeListNode *ptr_;
+		uintptr_t     tag_;
+	};
+
+	// on a line of its own (see SHP_FREELIST_PADDED)
+	alignas(LINE_ALIGN<std::atomic<Head>>)
+	std::atomic<Head> head_ { Head{ nullptr, 0 } };
+
+	// pop a node without taking it over
+	FreeListNode *pop()
+	{
+		Head cur = head_.load( std::memory_order_acquire );
+		while ( cur.ptr_ ) {
+			// 'cur.ptr_' may have been popped by another
+			// thread in the meantime; the 'next' pointer
+			// we read could then be stale (but the node
+			// still exists, see above) and the CAS fails
+			// because the tag has changed.
+			Head nxt { peekNext( cur.ptr_ ), cur.tag_ + 1 };
+			if ( head_.compare_exchange_weak( cur, nxt,
+			                                  std::memory_order_acquire,
+			                                  std::memory_order_acquire ) ) {
+				avail_.fetch_sub( 1, std::memory_order_relaxed );
+				return cur.ptr_;
+			}
+			stats_.contended();
+		}
+		return nullptr;
+	}
+
+protected:
+
+	virtual FreeListNode *getRaw() noexcept( NOEXCEPT ) override
+	{
+		auto p = pop();
+		if ( p ) {
+			setList( p, this );
+		}
+		return p;
+	}
+
+	virtual void putRaw(FreeListNode *p) noexcept( NOEXCEPT ) override
+	{
+		FreeListLockFree::putChainRaw( p, p, 1 );
+	}
+
+	// A chain is pushed with a single CAS.
+	virtual void putChainRaw(FreeListNode *head, FreeListNode *tail, unsigned count) noexcept( NOEXCEPT ) override
+	{
+		if ( ! head ) {
+			return;
+		}
+		// increment first so that a concurrent 'getRaw()'
+		// never makes the count wrap around (seq_cst; see
+		// FreeListBase::wakeWaiters()).
+		avail_.fetch_add( count );
+		Head cur = head_.load( std::memory_order_relaxed );
+		Head nxt;
+		while ( true ) {
+			setNext( tail, cur.ptr_ );
+			// pushing needs no new tag; only an interleaved
+			// pop can cause ABA.
+			nxt = Head{ head, cur.tag_ };
+			if ( head_.compare_exchange_weak( cur, nxt,
+			                                  std::memory_order_release,
+			                                  std::memory_order_relaxed ) ) {
+				break;
+			}
+			stats_.contended();
+		}
+		wakeWaiters( count );
+	}
+
+	// Up to 'n' nodes are removed with a single CAS: we walk
+	// 'n' links from the head and swing the head past the last
+	// node. Every pop bumps the tag and every push changes the
+	// head pointer, i.e., as long as the head is unchanged no node
+	// was removed and all the links we followed are valid.
+	//
+	// Unlike in 'pop()' the links are dereferenced: a node which
+	// another thread took over holds a list pointer (not a node)
+	// in its link. Each link is thus validated against the head
+	// before it is followed (the extra loads hit the line which
+	// the CAS needs anyway).
+	virtual unsigned getChainRaw(FreeListNode **headp, FreeListNode **tailp, unsigned n) noexcept( NOEXCEPT ) override
+	{
+		FreeListNode *tail = nullptr;
+		unsigned      cnt  = 0;
+		Head          cur  = head_.load( std::memory_order_acquire );
+		while ( cur.ptr_ && n ) {
+			FreeListNode *nxt;
+			tail = cur.ptr_;
+			cnt  = 1;
+			while ( true ) {
+				// acquire: the link is read before the head
+				nxt = peekNext( tail, std::memory_order_acquire );
+				Head chk = head_.load( std::memory_order_acquire );
+				if ( chk.ptr_ != cur.ptr_ || chk.tag_ != cur.tag_ ) {
+					cur = chk;
+					nxt = tail = nullptr;
+					break;
+				}
+				if ( ! nxt || cnt == n ) {
+					break;
+				}
+				tail = nxt;
+				++cnt;
+			}
+			if ( tail && head_.compare_exchange_weak( cur, Head{ nxt, cur.tag_ + 1 },
+			                                          std::memory_order_acquire,
+			                                          std::memory_order_acquire ) ) {
+				break;
+			}
+			stats_.contended();
+			tail = nullptr;
+			cnt  = 0;
+		}
+		if ( tail ) {
+			avail_.fetch_sub( cnt, std::memory_order_relaxed );
+			setNext( tail, nullptr );
+		}
+		if ( headp ) {
+			*headp = tail ? cur.ptr_ : nullptr;
+		}
+		if ( tailp ) {
+			*tailp = tail;
+		}
+		return cnt;
+	}
+
+public:
+	// nodes must outlive the list (see above)
+	static constexpr bool SAFE_DESTROY = false;
+
+	virtual ~FreeListLockFree() override
+	{
+		// the base class destructor would only see its own
+		// (empty) list; drain ours here.
+		if ( destroy_ ) {
+			while ( auto p = getRaw() ) {
+				destroy( p );
+			}
+		}
+	}
+};
+
+}; // namespace IntrusiveSmart
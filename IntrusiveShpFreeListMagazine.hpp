@@ -0,0 +1,276 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+#include <IntrusiveShpFreeList.hpp>
+
+// Per-thread magazine cache in front of a free list.
+//
+// Every thread using the list owns two small stacks of nodes
+// ('magazines'; see Bonwick & Adams, "Magazines and Vmem").
+// get() and put() are served from the calling thread's
+// magazines without touching shared state; only when both
+// magazines are empty (full) a full magazine's worth of nodes
+// is obtained from (returned to) the shared 'Depot' list.
+//
+// The 'Depot' may be any FreeListBase subclass (e.g., the
+// lock-free variant). Note that 'avail_' only accounts for
+// the nodes held by the depot. A thread whose magazine
+// cannot be allocated (on first use) uses the depot directly.
+//
+// The list must outlive all concurrent users; when it is
+// destroyed the nodes cached by any thread are deleted.
+// When a thread exits its cached nodes are returned to
+// the depot ('flushOnExit' or if the depot does not permit
+// destroying nodes while it is in use, see SAFE_DESTROY) or
+// deleted.
+
+namespace IntrusiveSmart {
+
+template <typename Depot = FreeListBase>
+class FreeListMagazine : public Depot {
+private:
+
+	struct Chain {
+		FreeListNode *head_{nullptr};
+		FreeListNode *tail_{nullptr};
+		unsigned      cnt_ {0};
+	};
+
+	struct Magazine {
+		// set to nullptr when the list is destroyed before
+		// the thread exits.
+		std::atomic<FreeListMagazine *> list_;
+		Magazine                       *nextInThread_{nullptr};
+		// invariant: 'previous_' is either empty or full
+		Chain                           loaded_;
+		Chain                           previous_;
+
+		Magazine(FreeListMagazine *l) : list_(l) {}
+	};
+
+	struct ThreadCache {
+		Magazine *mags_{nullptr};
+
+		~ThreadCache()
+		{
+			std::lock_guard<std::mutex> g( registryMtx() );
+			while ( auto m = mags_ ) {
+				mags_ = m->nextInThread_;
+				if ( auto l = m->list_.load( std::memory_order_relaxed ) ) {
+					l->retire( m );
+				}
+				delete m;
+			}
+		}
+	};
+
+	const unsigned          magSize_;
+	const bool              flushOnExit_;
+	// all magazines of this list (protected by registryMtx())
+	std::vector<Magazine *> mags_;
+
+	// the registry mutex must outlive any list since it is
+	// used by exiting threads.
+	static std::mutex &registryMtx()
+	{
+		static std::mutex m;
+		return m;
+	}
+
+	static ThreadCache &threadCache()
+	{
+		static thread_local ThreadCache tc;
+		return tc;
+	}
+
+	void push(Chain &c, FreeListNode *p)
+	{
+		FreeListBase::setNext( p, c.head_ );
+		if ( ! c.head_ ) {
+			c.tail_ = p;
+		}
+		c.head_ = p;
+		++c.cnt_;
+	}
+
+	FreeListNode *pop(Chain &c)
+	{
+		auto p  = c.head_;
+		c.head_ = FreeListBase::next( p );
+		if ( 0 == --c.cnt_ ) {
+			c.tail_ = nullptr;
+		}
+		return p;
+	}
+
+	// return a chain to the depot
+	void flush(Chain &c)
+	{
+		Depot::putChainRaw( c.head_, c.tail_, c.cnt_ );
+		c = Chain();
+	}
+
+	// fill an empty chain from the depot
+	void refill(Chain &c)
+	{
+		c.cnt_ = Depot::getChainRaw( &c.head_, &c.tail_, magSize_ );
+	}
+
+	void drain(Chain &c)
+	{
+		while ( c.cnt_ ) {
+			this->destroy( pop( c ) );
+		}
+	}
+
+	// called with the registry locked
+	void retire(Magazine *m)
+	{
+		// nodes which cannot be destroyed individually (or
+		// not while the depot is in use) are always returned
+		// to the depot.
+		if ( flushOnExit_ || ! this->destroy_ || ! Depot::SAFE_DESTROY ) {
+			flush( m->loaded_   );
+			flush( m->previous_ );
+		} else {
+			drain( m->loaded_   );
+			drain( m->previous_ );
+		}
+		mags_.erase( std::find( mags_.begin(), mags_.end(), m ) );
+	}
+
+	// slow path; find or create the calling thread's magazine
+	// and move it to the front of the thread's chain.
+	Magazine *lookup(ThreadCache &tc)
+	{
+		std::lock_guard<std::mutex> g( registryMtx() );
+		Magazine **pp = &tc.mags_;
+		Magazine  *m;
+		while ( (m = *pp) ) {
+			auto l = m->list_.load( std::memory_order_relaxed );
+			if ( this == l ) {
+				*pp = m->nextInThread_;
+				break;
+			}
+			if ( ! l ) {
+				// list is gone; purge
+				*pp = m->nextInThread_;
+				delete m;
+			} else {
+				pp = &m->nextInThread_;
+			}
+		}
+		if ( ! m ) {
+			mags_.reserve( mags_.size() + 1 );
+			m = new Magazine( this );
+			mags_.push_back( m );
+		}
+		m->nextInThread_ = tc.mags_;
+		tc.mags_         = m;
+		return m;
+	}
+
+	// returns nullptr if the magazine cannot be allocated;
+	// the caller then uses the depot directly.
+	Magazine *magazine() noexcept
+	{
+		ThreadCache &tc = threadCache();
+		Magazine    *m  = tc.mags_;
+		if ( m && this == m->list_.load( std::memory_order_relaxed ) ) {
+			return m;
+		}
+		try {
+			return lookup( tc );
+		} catch ( ... ) {
+			return nullptr;
+		}
+	}
+
+protected:
+
+	virtual FreeListNode *getRaw() noexcept( FreeListBase::NOEXCEPT ) override
+	{
+		Magazine *m = magazine();
+		if ( ! m ) {
+			return Depot::getRaw();
+		}
+		if ( 0 == m->loaded_.cnt_ ) {
+			if ( m->previous_.cnt_ ) {
+				std::swap( m->loaded_, m->previous_ );
+			} else {
+				refill( m->loaded_ );
+				if ( 0 == m->loaded_.cnt_ ) {
+					// some depots grow (FreeListSlabPool) or
+					// reclaim (FreeListDeferred) only in getRaw()
+					return Depot::getRaw();
+				}
+			}
+		}
+		auto p = pop( m->loaded_ );
+		FreeListBase::setList( p, this );
+		return p;
+	}
+
+	virtual void putRaw(FreeListNode *p) noexcept( FreeListBase::NOEXCEPT ) override
+	{
+		Magazine *m = magazine();
+		if ( ! m ) {
+			Depot::putRaw( p );
+			return;
+		}
+		if ( m->loaded_.cnt_ >= magSize_ ) {
+			if ( m->previous_.cnt_ ) {
+				flush( m->previous_ );
+			}
+			std::swap( m->loaded_, m->previous_ );
+		}
+		push( m->loaded_, p );
+	}
+
+public:
+
+	// any trailing arguments are passed to the constructor of
+	// the 'Depot' (e.g., the capacity of a FreeListArray).
+	template <typename... DepotArgs>
+	FreeListMagazine(unsigned magSize = 32, bool flushOnExit = true, DepotArgs&&... depotArgs)
+	: Depot       ( std::forward<DepotArgs>( depotArgs )... ),
+	  magSize_    ( magSize ? magSize : 1 ),
+	  flushOnExit_( flushOnExit           )
+	{
+	}
+
+	// return the calling thread's cached nodes to the depot
+	void flush()
+	{
+		Magazine *m = magazine();
+		if ( ! m ) {
+			return;
+		}
+		flush( m->loaded_   );
+		flush( m->previous_ );
+	}
+
+	unsigned magazineSize() const
+	{
+		return magSize_;
+	}
+
+	virtual ~FreeListMagazine() override
+	{
+		std::lock_guard<std::mutex> g( registryMtx() );
+		for ( auto m : mags_ ) {
+			if ( this->destroy_ ) {
+				drain( m->loaded_   );
+				drain( m->previous_ );
+			}
+			m->list_.store( nullptr, std::memory_order_relaxed );
+		}
+	}
+};
+
+}; // namespace IntrusiveSmart
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <IntrusiveShpFreeListSlab.hpp>
+
+// NUMA-partitioned pool of objects of type 'T'.
+//
+// Every (online) NUMA node has its own slab pool whose slabs are bound
+// to the node's memory. get() prefers the pool of the node the
+// calling thread is running on and steals from remote nodes
+// only if the local pool is exhausted (before growing it).
+// Since an object's 'list' is the pool it was taken from it
+// always returns to its home node when unmanaged.
+//
+// Node IDs need not be contiguous (e.g., "0-1,4"); the pools are
+// indexed 0..size()-1 and nodeId() maps an index to the node ID.
+
+namespace IntrusiveSmart {
+
+template <typename T, typename Base = FreeListBase>
+class FreeListNuma {
+public:
+	typedef FreeListSlabPool<T, Base> NodePool;
+
+private:
+	std::vector< std::unique_ptr<NodePool> > nodes_;
+	// node ID of every pool
+	std::vector<unsigned>                    ids_;
+	// pool index of every node ID (0 for IDs which are not online)
+	std::vector<unsigned>                    index_;
+
+public:
+	// parse a sysfs node list such as "0", "0-1" or "0-1,4,6-7"
+	static std::vector<unsigned> parseNodeList(const std::string &s)
+	{
+		std::vector<unsigned> ids;
+		std::size_t           pos = 0;
+		while ( pos < s.size() ) {
+			auto end = s.find( ',', pos );
+			if ( std::string::npos == end ) {
+				end = s.size();
+			}
+			if ( end > pos ) {
+				auto     range = s.substr( pos, end - pos );
+				auto     dash  = range.find( '-' );
+				unsigned lo    = std::stoul( range.substr( 0, dash ) );
+				unsigned hi    = std::string::npos == dash ? lo : std::stoul( range.substr( dash + 1 ) );
+				for ( unsigned id = lo; id <= hi; ++id ) {
+					ids.push_back( id );
+				}
+			}
+			pos = end + 1;
+		}
+		return ids;
+	}
+
+	// IDs of the online NUMA nodes (in ascending order)
+	static std::vector<unsigned> onlineNodes()
+	{
+		std::vector<unsigned> ids;
+#ifdef __linux__
+		std::ifstream f( "/sys/devices/system/node/online" );
+		std::string   s;
+		if ( f >> s ) {
+			ids = parseNodeList( s );
+		}
+#endif
+		if ( ids.empty() ) {
+			ids.push_back( 0 );
+		}
+		return ids;
+	}
+
+	// number of online NUMA nodes
+	static unsigned numNodes()
+	{
+		return onlineNodes().size();
+	}
+
+	// node (ID) of the calling thread
+	static unsigned currentNode()
+	{
+		unsigned node = 0;
+#if defined(__linux__) && defined(__GLIBC__) && ( __GLIBC__ > 2 || ( __GLIBC__ == 2 && __GLIBC_MINOR__ >= 29 ) )
+		unsigned cpu;
+		if ( getcpu( &cpu, &node ) ) {
+			node = 0;
+		}
+#endif
+		return node;
+	}
+
+	FreeListNuma(
+		unsigned                  objsPerSlab  = 1024,
+		unsigned                  prefillSlabs = 0,
+		bool                      hugePages    = false,
+		typename NodePool::Factory factory     = [](void *mem) { return new (mem) T(); })
+	: ids_( onlineNodes() )
+	{
+		index_.resize( ids_.back() + 1, 0 );
+		for ( unsigned i = 0; i < ids_.size(); ++i ) {
+			index_[ ids_[i] ] = i;
+			nodes_.push_back( std::make_unique<NodePool>( objsPerSlab, prefillSlabs, hugePages, factory, int(ids_[i]) ) );
+		}
+	}
+
+	Shp<T> get()
+	{
+		unsigned n     = nodes_.size();
+		unsigned node  = currentNode();
+		unsigned local = node < index_.size() ? index_[node] : 0;
+		for ( unsigned i = 0; i < n; ++i ) {
+			if ( auto p = nodes_[(local + i) % n]->tryGet() ) {
+				return p;
+			}
+		}
+		return nodes_[local]->get();
+	}
+
+	unsigned size() const
+	{
+		return nodes_.size();
+	}
+
+	// pool with index 'i' (not node ID; see nodeId())
+	NodePool &node(unsigned i)
+	{
+		return *nodes_[i];
+	}
+
+	// node ID of the pool with index 'i'
+	unsigned nodeId(unsigned i) const
+	{
+		return ids_[i];
+	}
+};
+
+}; // namespace IntrusiveSmart
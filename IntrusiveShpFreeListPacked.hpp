@@ -0,0 +1,220 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+#include <IntrusiveShp.hpp>
+
+// Compact pool for tiny objects (e.g., event records of a few
+// dozen bytes of which there may be tens of millions).
+//
+// A FreeListNode costs a vtable pointer, the count and a pointer
+// union (i.e., 24 bytes on a 64-bit machine). FreeListPackedNode
+// has no vtable (see ShpBaseT) and links free objects by a 32-bit
+// index rather than a pointer; with the default 32-bit count the
+// control block occupies 8 bytes:
+//
+//   struct Rec : FreeListPackedNode<Rec> { ... };
+//
+//   FreeListPacked<Rec> pool;
+//   Shp<Rec> r = pool.get();
+//
+// Objects live in slabs of SLAB_SIZE bytes which are aligned to
+// their size; the pool an object belongs to is found in the header
+// of its slab (by masking the object's address) so that the object
+// itself need not store a pointer to it.
+
+namespace IntrusiveSmart {
+
+template <typename T> class FreeListPacked;
+
+template <typename T>
+struct FreeListPackedRelease {
+	static void release(T *p);
+};
+
+template <typename T, typename Count = ShpAtomicCount, typename RefCnt = uint32_t>
+class FreeListPackedNode : public ShpBaseT<T, FreeListPackedRelease<T>, Count, RefCnt> {
+	friend class FreeListPacked<T>;
+private:
+	// index of the next free object; meaningful only while
+	// the object is on the free list.
+	uint32_t next_ {0};
+
+protected:
+	~FreeListPackedNode() = default;
+};
+
+template <typename T>
+class FreeListPacked {
+	friend struct FreeListPackedRelease<T>;
+public:
+	static constexpr std::size_t SLAB_SIZE = std::size_t(1) << 20;
+	static constexpr uint32_t    NIL       = ~uint32_t(0);
+
+private:
+	struct SlabHdr {
+		FreeListPacked *pool_;
+		// index of the slab's first object
+		uint32_t        base_;
+	};
+
+	static constexpr std::size_t ALIGN = alignof(T) > SHP_CACHELINE_SIZE ? alignof(T) : SHP_CACHELINE_SIZE;
+	static constexpr std::size_t HDR   = ( sizeof(SlabHdr) + ALIGN - 1 ) & ~( ALIGN - 1 );
+
+public:
+	// objects per slab
+	static constexpr uint32_t    NOBJS = ( SLAB_SIZE - HDR ) / sizeof(T);
+
+	static_assert( NOBJS > 0, "object too large for FreeListPacked" );
+
+private:
+	std::mutex            mtx_;
+	uint32_t              head_  {NIL};
+	std::vector<char *>   slabs_;
+	std::atomic<unsigned> avail_ {0};
+
+	static SlabHdr *slabOf(const T *p)
+	{
+		return reinterpret_cast<SlabHdr *>( reinterpret_cast<uintptr_t>( p ) & ~( SLAB_SIZE - 1 ) );
+	}
+
+	// called with the lock held
+	T *obj(uint32_t idx) const
+	{
+		return reinterpret_cast<T *>( slabs_[ idx / NOBJS ] + HDR + ( idx % NOBJS ) * sizeof(T) );
+	}
+
+	static uint32_t idx(const T *p)
+	{
+		SlabHdr *s = slabOf( p );
+		return s->base_ + ( reinterpret_cast<const char *>( p ) - reinterpret_cast<const char *>( s ) - HDR ) / sizeof(T);
+	}
+
+	// called with the lock held
+	void growLocked()
+	{
+		if ( ( slabs_.size() + 1 ) * std::size_t( NOBJS ) >= NIL ) {
+			throw std::bad_alloc();
+		}
+		// make sure push_back() below doesn't throw
+		slabs_.reserve( slabs_.size() + 1 );
+		char *mem = static_cast<char *>( std::aligned_alloc( SLAB_SIZE, SLAB_SIZE ) );
+		if ( ! mem ) {
+			throw std::bad_alloc();
+		}
+		uint32_t base = slabs_.size() * NOBJS;
+		new ( mem ) SlabHdr { this, base };
+		uint32_t old = head_;
+		uint32_t i   = NOBJS;
+		try {
+			// link in address order
+			while ( i > 0 ) {
+				--i;
+				T *p     = new ( mem + HDR + i * sizeof(T) ) T();
+				p->next_ = head_;
+				head_    = base + i;
+			}
+		} catch ( ... ) {
+			for ( uint32_t j = i + 1; j < NOBJS; ++j ) {
+				reinterpret_cast<T *>( mem + HDR + j * sizeof(T) )->~T();
+			}
+			head_ = old;
+			std::free( mem );
+			throw;
+		}
+		slabs_.push_back( mem );
+		avail_.fetch_add( NOBJS, std::memory_order_relaxed );
+	}
+
+	T *getRaw(bool grow)
+	{
+		std::unique_lock l( mtx_ );
+		if ( NIL == head_ ) {
+			if ( ! grow ) {
+				return nullptr;
+			}
+			growLocked();
+		}
+		T *p  = obj( head_ );
+		head_ = p->next_;
+		avail_.fetch_sub( 1, std::memory_order_relaxed );
+		return p;
+	}
+
+	void put(T *p)
+	{
+		uint32_t i = idx( p );
+		std::unique_lock l( mtx_ );
+		p->next_ = head_;
+		head_    = i;
+		avail_.fetch_add( 1, std::memory_order_relaxed );
+	}
+
+public:
+	FreeListPacked(unsigned prefillSlabs = 0)
+	{
+		std::unique_lock l( mtx_ );
+		for ( unsigned i = 0; i < prefillSlabs; ++i ) {
+			growLocked();
+		}
+	}
+
+	FreeListPacked(const FreeListPacked &)             = delete;
+	FreeListPacked & operator=(const FreeListPacked &) = delete;
+
+	// obtain an object; the pool grows if it is empty
+	Shp<T> get()
+	{
+		return Shp<T>( getRaw( true ) );
+	}
+
+	// obtain an object without growing the pool
+	Shp<T> tryGet()
+	{
+		return Shp<T>( getRaw( false ) );
+	}
+
+	// add a slab's worth of objects
+	void grow()
+	{
+		std::unique_lock l( mtx_ );
+		growLocked();
+	}
+
+	unsigned avail() const
+	{
+		return avail_.load( std::memory_order_relaxed );
+	}
+
+	std::size_t capacity()
+	{
+		std::unique_lock l( mtx_ );
+		return slabs_.size() * std::size_t( NOBJS );
+	}
+
+	// all objects must have been returned to the pool
+	~FreeListPacked()
+	{
+		for ( auto mem : slabs_ ) {
+			for ( uint32_t i = 0; i < NOBJS; ++i ) {
+				reinterpret_cast<T *>( mem + HDR + i * sizeof(T) )->~T();
+			}
+			std::free( mem );
+		}
+	}
+};
+
+template <typename T>
+void
+FreeListPackedRelease<T>::release(T *p)
+{
+	FreeListPacked<T>::slabOf( p )->pool_->put( p );
+}
+
+}; // namespace IntrusiveSmart
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#include <IntrusiveShpFreeList.hpp>
+
+// Self-growing and self-trimming pool of objects
+// of type 'T' on top of a free list.
+//
+//  - new objects are created by a user factory when the
+//    list runs empty ('chunk' objects at a time).
+//  - the list may be prefilled on construction.
+//  - objects returned while more than 'highWater' objects
+//    are available are deleted rather than enqueued.
+//    Alternatively ('trimInline == false'), put() always
+//    enqueues and some (background) thread periodically
+//    calls 'trim()'.
+//
+// Objects are released with 'delete' (unless the 'destroy_'
+// member is modified), i.e., the factory must create them
+// with 'new'.
+//
+// get() returns a null Shp if the list is empty and the factory
+// returns nullptr or throws (get() and put() never throw unless
+// SHP_FREELIST_CHECK is set; grow() and the constructor propagate
+// exceptions thrown by the factory).
+//
+// If 'Base' does not permit destroying nodes while the list
+// is in use (Base::SAFE_DESTROY is false, e.g., FreeListLockFree)
+// the pool never trims: 'highWater' is ignored and trim() is
+// a no-op.
+
+namespace IntrusiveSmart {
+
+template <typename T, typename Base = FreeListBase>
+class FreeListPool : public Base {
+	static_assert( std::is_base_of<FreeListNode, T>::value );
+public:
+	typedef std::function<T*()> Factory;
+
+private:
+	Factory        factory_;
+	const unsigned chunk_;
+	const unsigned highWater_;
+	const bool     trimInline_;
+
+	// create up to 'n' objects; returns the number created
+	unsigned create(FreeListNode **headp, FreeListNode **tailp, unsigned n)
+	{
+		FreeListNode *head = nullptr;
+		FreeListNode *tail = nullptr;
+		unsigned      cnt  = 0;
+		try {
+			while ( cnt < n ) {
+				FreeListNode *p = factory_();
+				if ( ! p ) {
+					break;
+				}
+				FreeListBase::setNext( p, head );
+				if ( ! tail ) {
+					tail = p;
+				}
+				head = p;
+				++cnt;
+			}
+		} catch ( ... ) {
+			Base::putChainRaw( head, tail, cnt );
+			this->countPuts( cnt );
+			throw;
+		}
+		*headp = head;
+		*tailp = tail;
+		return cnt;
+	}
+
+protected:
+
+	virtual FreeListNode *getRaw() noexcept( FreeListBase::NOEXCEPT ) override
+	{
+		if ( auto p = Base::getRaw() ) {
+			return p;
+		}
+		// list is empty; grow. We hand out one of
+		// the new objects and enqueue the rest.
+		FreeListNode *head, *tail;
+		unsigned      cnt;
+		try {
+			cnt = create( &head, &tail, chunk_ );
+		} catch ( ... ) {
+			// the objects created before the failure
+			// have been enqueued by create().
+			return Base::getRaw();
+		}
+		if ( 0 == cnt ) {
+			return nullptr;
+		}
+		auto p = head;
+		head   = FreeListBase::next( p );
+		Base::putChainRaw( head, tail, cnt - 1 );
+		this->countPuts( cnt - 1 );
+		FreeListBase::setList( p, this );
+		return p;
+	}
+
+	virtual void putRaw(FreeListNode *p) noexcept( FreeListBase::NOEXCEPT ) override
+	{
+		if (    Base::SAFE_DESTROY
+		     && trimInline_
+		     && this->avail_.load( std::memory_order_relaxed ) >= highWater_ ) {
+			this->destroy( p );
+		} else {
+			Base::putRaw( p );
+		}
+	}
+
+	virtual void putChainRaw(FreeListNode *head, FreeListNode *tail, unsigned count) noexcept( FreeListBase::NOEXCEPT ) override
+	{
+		Base::putChainRaw( head, tail, count );
+		if ( trimInline_ ) {
+			trim();
+		}
+	}
+
+	// a batch request is topped up with new objects
+	virtual unsigned getChainRaw(FreeListNode **headp, FreeListNode **tailp, unsigned n) noexcept( FreeListBase::NOEXCEPT ) override
+	{
+		FreeListNode *head, *tail;
+		unsigned      cnt = Base::getChainRaw( &head, &tail, n );
+		if ( cnt < n ) {
+			FreeListNode *xhead, *xtail;
+			unsigned      xcnt;
+			try {
+				xcnt = create( &xhead, &xtail, n - cnt );
+			} catch ( ... ) {
+				// hand out what we have; the objects created
+				// before the failure have been enqueued.
+				xcnt = 0;
+			}
+			if ( xcnt ) {
+				if ( cnt ) {
+					FreeListBase::setNext( tail, xhead );
+				} else {
+					head = xhead;
+				}
+				tail = xtail;
+				cnt += xcnt;
+			}
+		}
+		if ( headp ) {
+			*headp = head;
+		}
+		if ( tailp ) {
+			*tailp = tail;
+		}
+		return cnt;
+	}
+
+public:
+
+	// any trailing arguments are passed to the constructor of
+	// 'Base' (e.g., the capacity of a FreeListArray).
+	template <typename... BaseArgs>
+	FreeListPool(
+		Factory  factory    = []() { return new T(); },
+		unsigned prefill    = 0,
+		unsigned chunk      = 1,
+		unsigned highWater  = ~0U,
+		bool     trimInline = true,
+		BaseArgs&&... baseArgs)
+	: Base       ( std::forward<BaseArgs>( baseArgs )... ),
+	  factory_   ( factory                 ),
+	  chunk_     ( chunk     ? chunk     : 1 ),
+	  highWater_ ( highWater               ),
+	  trimInline_( trimInline              )
+	{
+		// make() grows through the factory (in getRaw())
+		this->makeNew_ = false;
+		grow( prefill );
+	}
+
+	// add 'n' new objects to the list; returns the
+	// number of objects actually created.
+	unsigned grow(unsigned n)
+	{
+		FreeListNode *head, *tail;
+		unsigned      cnt = create( &head, &tail, n );
+		Base::putChainRaw( head, tail, cnt );
+		this->countPuts( cnt );
+		return cnt;
+	}
+
+	// delete available objects in excess of the
+	// high watermark; returns the number deleted.
+	unsigned trim()
+	{
+		if constexpr ( ! Base::SAFE_DESTROY ) {
+			return 0;
+		}
+		unsigned avail = this->avail_.load( std::memory_order_relaxed );
+		if ( avail <= highWater_ ) {
+			return 0;
+		}
+		FreeListNode *p;
+		unsigned      cnt = Base::getChainRaw( &p, nullptr, avail - highWater_ );
+		for ( unsigned i = 0; i < cnt; ++i ) {
+			auto nxt = FreeListBase::next( p );
+			this->destroy( p );
+			p = nxt;
+		}
+		return cnt;
+	}
+
+	using Base::get;
+
+	Shp<T>
+	get() noexcept( FreeListBase::NOEXCEPT )
+	{
+		return Base::template get<T>();
+	}
+};
+
+}; // namespace IntrusiveSmart
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <IntrusiveShpFreeList.hpp>
+
+// Slab-backed pool: objects are allocated in contiguous,
+// cache-line aligned slabs (optionally backed by huge pages)
+// rather than one by one. Recycled objects thus stay close
+// together in memory and the whole pool is released slab
+// by slab.
+
+namespace IntrusiveSmart {
+
+// Raw slab memory; all slabs are released when the arena
+// is destroyed. The memory may optionally be bound to a
+// (preferred) NUMA node (linux only; -1: no preference).
+class FreeListSlabArena {
+public:
+	static constexpr std::size_t CACHELINE = SHP_CACHELINE_SIZE;
+	static constexpr std::size_t HUGEPAGE  = 2*1024*1024;
+	static constexpr std::size_t PAGE      = 4096;
+
+private:
+	struct Slab {
+		void        *mem_;
+		std::size_t  size_;
+		bool         mapped_;
+	};
+
+	std::vector<Slab> slabs_;
+	const bool        hugePages_;
+	const int         numaNode_;
+
+#ifdef __linux__
+	void bindToNode(void *mem, std::size_t size)
+	{
+		// MPOL_PREFERRED; the memory has not been touched yet
+		const int     MPOL_PREF = 1;
+		unsigned long mask      = 1UL << numaNode_;
+		syscall( SYS_mbind, mem, size, MPOL_PREF, &mask, sizeof(mask)*8, 0 );
+	}
+#endif
+
+public:
+	FreeListSlabArena(bool hugePages = false, int numaNode = -1)
+	: hugePages_( hugePages ),
+	  numaNode_ ( numaNode < int(sizeof(unsigned long)*8) ? numaNode : -1 )
+	{
+	}
+
+	FreeListSlabArena(const FreeListSlabArena &)             = delete;
+	FreeListSlabArena & operator=(const FreeListSlabArena &) = delete;
+
+	// allocate a new cache-line aligned slab of at
+	// least 'size' bytes
+	void *allocate(std::size_t size)
+	{
+		slabs_.reserve( slabs_.size() + 1 );
+#ifdef __linux__
+		if ( hugePages_ || numaNode_ >= 0 ) {
+			void *mem = MAP_FAILED;
+			if ( hugePages_ ) {
+				size = (size + HUGEPAGE - 1) & ~(HUGEPAGE - 1);
+				mem  = mmap( nullptr, size, PROT_READ | PROT_WRITE,
+				             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+			} else {
+				size = (size + PAGE - 1) & ~(PAGE - 1);
+			}
+			if ( MAP_FAILED == mem ) {
+				// no reserved huge pages; try transparent ones
+				mem = mmap( nullptr, size, PROT_READ | PROT_WRITE,
+				            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+				if ( MAP_FAILED == mem ) {
+					throw std::bad_alloc();
+				}
+				if ( hugePages_ ) {
+					madvise( mem, size, MADV_HUGEPAGE );
+				}
+			}
+			if ( numaNode_ >= 0 ) {
+				bindToNode( mem, size );
+			}
+			slabs_.push_back( Slab{ mem, size, true } );
+			return mem;
+		}
+#endif
+		size = (size + CACHELINE - 1) & ~(CACHELINE - 1);
+		void *mem = std::aligned_alloc( CACHELINE, size );
+		if ( ! mem ) {
+			throw std::bad_alloc();
+		}
+		slabs_.push_back( Slab{ mem, size, false } );
+		return mem;
+	}
+
+	std::size_t numSlabs() const
+	{
+		return slabs_.size();
+	}
+
+	~FreeListSlabArena()
+	{
+		for ( auto &s : slabs_ ) {
+#ifdef __linux__
+			if ( s.mapped_ ) {
+				munmap( s.mem_, s.size_ );
+				continue;
+			}
+#endif
+			std::free( s.mem_ );
+		}
+	}
+};
+
+// Pool of objects of type 'T' which are constructed in
+// slabs of 'objsPerSlab' objects. A new slab is added
+// whenever the list runs empty. Objects are never deleted
+// individually; they are destroyed (in slab order) and their
+// memory released when the pool is destroyed. At that point
+// all objects must have been returned to the pool.
+//
+// The factory constructs an object in the storage it
+// is passed (placement new). get() returns a null Shp if
+// a new slab cannot be allocated or constructed (grow() and
+// the constructor propagate the exception).
+template <typename T, typename Base = FreeListBase>
+class FreeListSlabPool : public Base {
+	static_assert( std::is_base_of<FreeListNode, T>::value );
+public:
+	typedef std::function<T*(void *)> Factory;
+
+private:
+	struct SlabInfo {
+		T        *objs_;
+		unsigned  cnt_;
+	};
+
+	Factory               factory_;
+	const unsigned        objsPerSlab_;
+	// protects the arena and slab table while growing
+	std::mutex            growMtx_;
+	FreeListSlabArena     arena_;
+	std::vector<SlabInfo> slabs_;
+
+	// construct a new slab; returns the number of objects
+	unsigned create(FreeListNode **headp, FreeListNode **tailp)
+	{
+		std::unique_lock l( growMtx_ );
+		slabs_.reserve( slabs_.size() + 1 );
+		T *objs = static_cast<T*>( arena_.allocate( sizeof(T) * objsPerSlab_ ) );
+		slabs_.push_back( SlabInfo{ objs, 0 } );
+		SlabInfo     &s    = slabs_.back();
+		FreeListNode *head = nullptr;
+		// link in address order so that consecutive get()
+		// calls hand out adjacent objects.
+		try {
+			for ( unsigned i = objsPerSlab_; i > 0; --i ) {
+				FreeListNode *p = factory_( &objs[i - 1] );
+				FreeListBase::setNext( p, head );
+				head = p;
+				s.cnt_++;
+			}
+		} catch ( ... ) {
+			Base::putChainRaw( head, &objs[objsPerSlab_ - 1], s.cnt_ );
+			this->countPuts( s.cnt_ );
+			throw;
+		}
+		*headp = head;
+		*tailp = &objs[objsPerSlab_ - 1];
+		return s.cnt_;
+	}
+
+protected:
+
+	virtual FreeListNode *getRaw() noexcept( FreeListBase::NOEXCEPT ) override
+	{
+		if ( auto p = Base::getRaw() ) {
+			return p;
+		}
+		FreeListNode *head, *tail;
+		try {
+			create( &head, &tail );
+		} catch ( ... ) {
+			// out of memory or the factory failed; the objects
+			// constructed so far have been enqueued by create().
+			return Base::getRaw();
+		}
+		auto p = head;
+		if ( head != tail ) {
+			Base::putChainRaw( FreeListBase::next( p ), tail, objsPerSlab_ - 1 );
+			this->countPuts( objsPerSlab_ - 1 );
+		}
+		FreeListBase::setList( p, this );
+		return p;
+	}
+
+public:
+
+	// any trailing arguments are passed to the constructor of
+	// 'Base' (e.g., the capacity of a FreeListArray).
+	template <typename... BaseArgs>
+	FreeListSlabPool(
+		unsigned objsPerSlab  = 1024,
+		unsigned prefillSlabs = 0,
+		bool     hugePages    = false,
+		Factory  factory      = [](void *mem) { return new (mem) T(); },
+		int      numaNode     = -1,
+		BaseArgs&&... baseArgs)
+	: Base        ( std::forward<BaseArgs>( baseArgs )... ),
+	  factory_    ( factory                     ),
+	  objsPerSlab_( objsPerSlab ? objsPerSlab : 1 ),
+	  arena_      ( hugePages, numaNode         )
+	{
+		// objects must not be deleted individually
+		this->destroy_ = nullptr;
+		this->makeNew_ = false;
+		while ( prefillSlabs-- > 0 ) {
+			grow();
+		}
+	}
+
+	// add a new slab to the pool
+	void grow()
+	{
+		FreeListNode *head, *tail;
+		unsigned      cnt = create( &head, &tail );
+		Base::putChainRaw( head, tail, cnt );
+		this->countPuts( cnt );
+	}
+
+	std::size_t numSlabs()
+	{
+		std::unique_lock l( growMtx_ );
+		return slabs_.size();
+	}
+
+	using Base::get;
+
+	Shp<T>
+	get() noexcept( FreeListBase::NOEXCEPT )
+	{
+		return Base::template get<T>();
+	}
+
+	// obtain an available object; never grows the pool
+	Shp<T>
+	tryGet() noexcept( FreeListBase::NOEXCEPT )
+	{
+		auto p = Base::getRaw();
+		this->stats_.get( !!p, this->avail() );
+		return Shp<T>( static_cast<T*>( p ) );
+	}
+
+	virtual ~FreeListSlabPool() override
+	{
+		// 'destroy_' is nullptr, i.e., the base classes'
+		// destructors won't touch the objects.
+		for ( auto &s : slabs_ ) {
+			for ( unsigned i = objsPerSlab_ - s.cnt_; i < objsPerSlab_; ++i ) {
+				s.objs_[i].~T();
+			}
+		}
+	}
+};
+
+}; // namespace IntrusiveSmart
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+
+// Free-list instrumentation. Statistics are compiled out unless
+// SHP_FREELIST_STATS is defined (consistently in all translation
+// units!), in which case every FreeListBase counts
+//
+//  - gets, puts (objects added by put()/putChain(), i.e., released
+//    by their last Shp or added by the user, and objects created
+//    when a pool grows or is prefilled) and misses (gets which
+//    found the list empty),
+//  - contention: lock acquisitions which had to wait (mutex-based
+//    lists) or failed CAS attempts (lock-free lists),
+//  - the minimum and maximum ('high-water') number of available
+//    objects observed by get/put.
+//
+// FreeListBase::stats() returns a snapshot of the counters of
+// a list; FreeListStats::thisThread() the calling thread's counts
+// accumulated over all lists. Counters are updated with relaxed
+// atomic operations; a snapshot is thus not necessarily consistent
+// across counters.
+
+namespace IntrusiveSmart {
+
+class FreeListStats {
+public:
+	struct Snapshot {
+		uint64_t gets_      {0};
+		uint64_t puts_      {0};
+		uint64_t misses_    {0};
+		uint64_t contended_ {0};
+		// per-list only
+		unsigned avail_     {0};
+		unsigned minAvail_  {0};
+		unsigned maxAvail_  {0};
+	};
+
+#ifdef SHP_FREELIST_STATS
+	static constexpr bool ENABLED = true;
+
+private:
+	std::atomic<uint64_t> gets_      {0};
+	std::atomic<uint64_t> puts_      {0};
+	std::atomic<uint64_t> misses_    {0};
+	std::atomic<uint64_t> contended_ {0};
+	std::atomic<unsigned> minAvail_  {~0U};
+	std::atomic<unsigned> maxAvail_  {0};
+
+	static Snapshot &local()
+	{
+		static thread_local Snapshot s;
+		return s;
+	}
+
+	static void inc(std::atomic<uint64_t> &c, uint64_t n = 1)
+	{
+		c.fetch_add( n, std::memory_order_relaxed );
+	}
+
+	void occupancy(unsigned avail)
+	{
+		unsigned v = minAvail_.load( std::memory_order_relaxed );
+		while ( avail < v && ! minAvail_.compare_exchange_weak( v, avail, std::memory_order_relaxed ) )
+			;
+		v = maxAvail_.load( std::memory_order_relaxed );
+		while ( avail > v && ! maxAvail_.compare_exchange_weak( v, avail, std::memory_order_relaxed ) )
+			;
+	}
+
+public:
+	void get(bool hit, unsigned avail)
+	{
+		inc( gets_ );
+		++local().gets_;
+		if ( ! hit ) {
+			inc( misses_ );
+			++local().misses_;
+		}
+		occupancy( avail );
+	}
+
+	void put(unsigned avail, unsigned n = 1)
+	{
+		inc( puts_, n );
+		local().puts_ += n;
+		occupancy( avail );
+	}
+
+	void contended(uint64_t n = 1)
+	{
+		inc( contended_, n );
+		local().contended_ += n;
+	}
+
+	Snapshot snapshot(unsigned avail) const
+	{
+		Snapshot s;
+		s.gets_      = gets_.load( std::memory_order_relaxed );
+		s.puts_      = puts_.load( std::memory_order_relaxed );
+		s.misses_    = misses_.load( std::memory_order_relaxed );
+		s.contended_ = contended_.load( std::memory_order_relaxed );
+		s.avail_     = avail;
+		s.minAvail_  = minAvail_.load( std::memory_order_relaxed );
+		s.maxAvail_  = maxAvail_.load( std::memory_order_relaxed );
+		if ( s.minAvail_ > s.maxAvail_ ) {
+			// nothing observed yet
+			s.minAvail_ = s.maxAvail_ = avail;
+		}
+		return s;
+	}
+
+	static Snapshot thisThread()
+	{
+		return local();
+	}
+
+	// lock 'm', counting contention
+	template <typename M>
+	std::unique_lock<M> lock(M &m)
+	{
+		std::unique_lock<M> l( m, std::try_to_lock );
+		if ( ! l.owns_lock() ) {
+			contended();
+			l.lock();
+		}
+		return l;
+	}
+#else
+	static constexpr bool ENABLED = false;
+
+	void get(bool, unsigned)
+	{
+	}
+
+	void put(unsigned, unsigned = 1)
+	{
+	}
+
+	void contended(uint64_t = 1)
+	{
+	}
+
+	Snapshot snapshot(unsigned avail) const
+	{
+		Snapshot s;
+		s.avail_ = s.minAvail_ = s.maxAvail_ = avail;
+		return s;
+	}
+
+	static Snapshot thisThread()
+	{
+		return Snapshot();
+	}
+
+	template <typename M>
+	std::unique_lock<M> lock(M &m)
+	{
+		return std::unique_lock<M>( m );
+	}
+#endif
+};
+
+}; // namespace IntrusiveSmart
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include <IntrusiveShp.hpp>
+
+// Free list for objects without a vtable; the static
+// counterpart of FreeListNode/FreeListBase.
+//
+// Objects derive from FreeListNodeT<T> (CRTP). When the
+// last reference is dropped the object is put back on its
+// FreeListT<T> by a non-virtual (and inlinable) call.
+//
+//   struct Msg : FreeListNodeT<Msg> { ... };
+//
+//   FreeListT<Msg> list;
+//   list.put( new Msg() );
+//   Shp<Msg> m = list.get();
+
+namespace IntrusiveSmart {
+
+template <typename T> class FreeListT;
+
+template <typename T>
+struct FreeListReleaseT {
+	static void release(T *p);
+};
+
+template <typename T, typename Count = ShpAtomicCount>
+class FreeListNodeT : public ShpBaseT<T, FreeListReleaseT<T>, Count> {
+	friend class  FreeListT<T>;
+	friend struct FreeListReleaseT<T>;
+private:
+	// see FreeListNode
+	mutable union U {
+		std::atomic<FreeListT<T> *> list_;
+		std::atomic<T *>            next_;
+		U() : next_(nullptr) {}
+	} u_;
+
+protected:
+	~FreeListNodeT() = default;
+};
+
+template <typename T>
+class FreeListT {
+private:
+
+	T                     *anchor_ {nullptr};
+	std::mutex             mtx_;
+	std::atomic<unsigned>  avail_{0};
+
+public:
+	FreeListT() = default;
+
+	FreeListT(const FreeListT &)             = delete;
+	FreeListT & operator=(const FreeListT &) = delete;
+
+	// Enqueue object on the free list (new objects
+	// have a zero reference count and may simply be
+	// added to the list).
+	void put(T *p)
+	{
+		std::unique_lock l( mtx_ );
+		p->u_.next_.store( anchor_, std::memory_order_relaxed );
+		anchor_ = p;
+		avail_.fetch_add( 1, std::memory_order_relaxed );
+	}
+
+	// obtain a new shared pointer-managed object
+	// from the list.
+	Shp<T> get()
+	{
+		T *p;
+		{
+			std::unique_lock l( mtx_ );
+			if ( ( p = anchor_ ) ) {
+				anchor_ = p->u_.next_.load( std::memory_order_relaxed );
+				avail_.fetch_sub( 1, std::memory_order_relaxed );
+			}
+		}
+		if ( p ) {
+			p->u_.list_.store( this, std::memory_order_relaxed );
+		}
+		return Shp<T>( p );
+	}
+
+	// see FreeListBase::make()
+	template <typename... Args>
+	Shp<T> make(Args&&... args)
+	{
+		static_assert( sizeof...(Args) == 0 || ShpHasReinit<T, Args...>::value,
+		               "T must provide reinit(Args...)" );
+		Shp<T> rv = get();
+		if ( rv ) {
+			if constexpr ( ShpHasReinit<T, Args...>::value ) {
+				rv->reinit( std::forward<Args>( args )... );
+			}
+		} else {
+			T *p = new T( std::forward<Args>( args )... );
+			p->u_.list_.store( this, std::memory_order_relaxed );
+			rv = Shp<T>( p );
+		}
+		return rv;
+	}
+
+	unsigned avail() const
+	{
+		return avail_.load( std::memory_order_relaxed );
+	}
+
+	~FreeListT()
+	{
+		while ( auto p = anchor_ ) {
+			anchor_ = p->u_.next_.load( std::memory_order_relaxed );
+			delete p;
+		}
+	}
+};
+
+template <typename T>
+void
+FreeListReleaseT<T>::release(T *p)
+{
+	p->u_.list_.load( std::memory_order_relaxed )->put( p );
+}
+
+}; // namespace IntrusiveSmart
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include <IntrusiveShp.hpp>
+
+// Intrusive queue handing over Shp's between threads.
+//
+// Objects to be queued derive from ShpQueueNode<Base> where 'Base'
+// is the control block otherwise used (FreeListNode, ShpBase, ...):
+//
+//   struct Work : ShpQueueNode<FreeListNode> { ... };
+//
+// ShpQueueNode adds a dedicated link; it is not shared with the
+// FreeListNode's pointer union (which holds the list while the
+// object is managed). Pushing an Shp transfers its reference to the
+// queue and pop() transfers it to the consumer (see Shp::detach()
+// and ShpAdopt): a hand-off neither allocates nor modifies the
+// reference count.
+//
+// The queue is D. Vyukov's intrusive MPSC queue: push() is wait-free
+// (a single atomic exchange) and may be called by any number of
+// threads. With 'MultiConsumer == false' only one thread may pop();
+// otherwise consumers serialize on a lock (producers are never
+// blocked).
+//
+// NOTE: an object may be on at most one queue at a time (it has
+//       only one link); in particular the same object must not be
+//       pushed again before it has been popped.
+//       pop() may find the queue empty while a push is in progress.
+
+namespace IntrusiveSmart {
+
+template <typename T, bool MultiConsumer> class ShpQueue;
+
+class ShpQueueLink {
+	template <typename T, bool MultiConsumer> friend class ShpQueue;
+private:
+	std::atomic<ShpQueueLink *> qnext_ {nullptr};
+
+protected:
+	ShpQueueLink() = default;
+	// the link is not part of an object's value
+	ShpQueueLink(const ShpQueueLink &)
+	{
+	}
+
+	ShpQueueLink & operator=(const ShpQueueLink &)
+	{
+		return *this;
+	}
+};
+
+template <typename Base = ShpBase>
+class ShpQueueNode : public Base, public ShpQueueLink {
+public:
+	using Base::Base;
+};
+
+template <typename T, bool MultiConsumer = false>
+class ShpQueue {
+private:
+	alignas(SHP_CACHELINE_SIZE)
+	std::atomic<ShpQueueLink *> head_;
+	alignas(SHP_CACHELINE_SIZE)
+	ShpQueueLink               *tail_;
+	ShpQueueLink                stub_;
+	std::mutex                  consumerMtx_;
+
+	void pushLink(ShpQueueLink *n)
+	{
+		n->qnext_.store( nullptr, std::memory_order_relaxed );
+		ShpQueueLink *prev = head_.exchange( n, std::memory_order_acq_rel );
+		// the queue is disconnected until 'prev' is linked
+		prev->qnext_.store( n, std::memory_order_release );
+	}
+
+	ShpQueueLink *popLink()
+	{
+		ShpQueueLink *tail = tail_;
+		ShpQueueLink *next = tail->qnext_.load( std::memory_order_acquire );
+		if ( tail == &stub_ ) {
+			if ( ! next ) {
+				return nullptr;
+			}
+			tail_ = next;
+			tail  = next;
+			next  = next->qnext_.load( std::memory_order_acquire );
+		}
+		if ( next ) {
+			tail_ = next;
+			return tail;
+		}
+		if ( tail != head_.load( std::memory_order_acquire ) ) {
+			// a push is in progress
+			return nullptr;
+		}
+		// 'tail' is the last node; re-insert the stub so that
+		// it can be removed.
+		pushLink( &stub_ );
+		next = tail->qnext_.load( std::memory_order_acquire );
+		if ( next ) {
+			tail_ = next;
+			return tail;
+		}
+		return nullptr;
+	}
+
+public:
+	ShpQueue()
+	: head_( &stub_ ),
+	  tail_( &stub_ )
+	{
+	}
+
+	ShpQueue(const ShpQueue &)             = delete;
+	ShpQueue & operator=(const ShpQueue &) = delete;
+
+	// enqueue; the reference is transferred to the queue
+	template <typename U>
+	void push(Shp<U> &&p)
+	{
+		static_assert( std::is_convertible<U*, T*>::value, "incompatible Shp" );
+		if ( T *raw = p.detach() ) {
+			pushLink( raw );
+		}
+	}
+
+	// enqueue a new reference
+	template <typename U>
+	void push(const Shp<U> &p)
+	{
+		push( Shp<U>( p ) );
+	}
+
+	// dequeue; returns a null Shp if the queue is empty
+	Shp<T> pop()
+	{
+		ShpQueueLink *l;
+		if constexpr ( MultiConsumer ) {
+			std::unique_lock g( consumerMtx_ );
+			l = popLink();
+		} else {
+			l = popLink();
+		}
+		return Shp<T>( static_cast<T *>( l ), ShpAdopt() );
+	}
+
+	// no consumer may run concurrently
+	~ShpQueue()
+	{
+		while ( pop() )
+			;
+	}
+};
+
+}; // namespace IntrusiveSmart
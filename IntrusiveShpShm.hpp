@@ -0,0 +1,224 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+
+#include <IntrusiveShp.hpp>
+
+// Process-shared pool: objects live in memory which is mapped by
+// several processes (e.g., a memfd or POSIX shared memory object)
+// and may be handed from one process to another without copying.
+//
+// Nothing in the shared mapping holds a (process-local) address:
+//  - objects have no vtable (ShmNode is a ShpBaseT);
+//  - a node locates the pool header by a self-relative offset;
+//  - free objects are linked by index and the head of the
+//    (lock-free) free list is an index plus an ABA tag in a
+//    single 64-bit word.
+// An Shp<T> holds the address of the object in the mapping of the
+// process which holds it; between processes a reference is passed
+// as an index:
+//
+//   struct Buf : ShmNode<Buf> { char data_[4096]; };
+//
+//   // creating process
+//   void *mem = mmap( ..., ShmPool<Buf>::bytesFor( n ), ..., MAP_SHARED, memfd, 0 );
+//   ShmPool<Buf> pool( mem, ShmPool<Buf>::bytesFor( n ), true );
+//   Shp<Buf>     b = pool.get();
+//   uint32_t     h = pool.detach( std::move( b ) ); // send 'h' to peer
+//
+//   // attaching process
+//   ShmPool<Buf> pool( mem, size, false );
+//   Shp<Buf>     b = pool.adopt( h );
+//
+// Objects are constructed by the creating process and never
+// destroyed; 'T' must thus be trivially destructible and must not
+// hold process-local pointers. References held by a process which
+// dies are lost.
+
+namespace IntrusiveSmart {
+
+template <typename T> class ShmPool;
+
+template <typename T>
+struct ShmRelease {
+	static void release(T *p);
+};
+
+template <typename T, typename Count = ShpAtomicCount, typename RefCnt = int32_t>
+class ShmNode : public ShpBaseT<T, ShmRelease<T>, Count, RefCnt> {
+	friend class  ShmPool<T>;
+	friend struct ShmRelease<T>;
+private:
+	// offset from the pool header to this node
+	std::ptrdiff_t        hdrOff_ {0};
+	uint32_t              idx_    {0};
+	// index of the next free object
+	std::atomic<uint32_t> next_   {0};
+
+protected:
+	~ShmNode() = default;
+};
+
+template <typename T>
+class ShmPool {
+	friend struct ShmRelease<T>;
+public:
+	static constexpr uint32_t NIL = ~uint32_t(0);
+
+private:
+	static constexpr uint64_t MAGIC = 0x53687053686d5031ULL; // "ShpShmP1"
+
+	struct Hdr {
+		// set once the pool is constructed
+		std::atomic<uint64_t> magic_;
+		uint64_t              objSize_;
+		uint32_t              nobjs_;
+		// (tag << 32) | index
+		alignas(SHP_CACHELINE_SIZE)
+		std::atomic<uint64_t> head_;
+		std::atomic<uint32_t> avail_;
+	};
+
+	static_assert( std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+	               "process-shared atomics must be lock-free" );
+	static_assert( std::is_trivially_destructible<T>::value,
+	               "objects in shared memory are never destroyed" );
+
+	static constexpr std::size_t ALIGN = alignof(T) > alignof(Hdr) ? alignof(T) : alignof(Hdr);
+	static constexpr std::size_t HDR   = ( sizeof(Hdr) + ALIGN - 1 ) & ~( ALIGN - 1 );
+
+	Hdr *hdr_;
+
+	static T *obj(Hdr *h, uint32_t idx)
+	{
+		return reinterpret_cast<T *>( reinterpret_cast<char *>( h ) + HDR + std::size_t( idx ) * sizeof(T) );
+	}
+
+	static void push(Hdr *h, T *p)
+	{
+		uint64_t cur = h->head_.load( std::memory_order_relaxed );
+		h->avail_.fetch_add( 1, std::memory_order_relaxed );
+		do {
+			p->next_.store( uint32_t( cur ), std::memory_order_relaxed );
+		} while ( ! h->head_.compare_exchange_weak( cur, ( cur & ~uint64_t( NIL ) ) | p->idx_,
+		                                            std::memory_order_release,
+		                                            std::memory_order_relaxed ) );
+	}
+
+	static T *pop(Hdr *h)
+	{
+		uint64_t cur = h->head_.load( std::memory_order_acquire );
+		while ( NIL != uint32_t( cur ) ) {
+			T *p = obj( h, uint32_t( cur ) );
+			// see FreeListLockFree; 'next_' may be stale but
+			// the CAS fails since the tag has changed.
+			uint64_t nxt = ( ( ( cur >> 32 ) + 1 ) << 32 ) | p->next_.load( std::memory_order_relaxed );
+			if ( h->head_.compare_exchange_weak( cur, nxt,
+			                                     std::memory_order_acquire,
+			                                     std::memory_order_acquire ) ) {
+				h->avail_.fetch_sub( 1, std::memory_order_relaxed );
+				return p;
+			}
+		}
+		return nullptr;
+	}
+
+public:
+	// size of a mapping holding 'n' objects
+	static constexpr std::size_t bytesFor(uint32_t n)
+	{
+		return HDR + std::size_t( n ) * sizeof(T);
+	}
+
+	// 'mem' must be suitably aligned (page-aligned mappings are).
+	// 'create': construct the pool (and all objects) in 'mem';
+	// otherwise attach to a pool created by another process
+	// (throws std::invalid_argument if the pool is incompatible).
+	ShmPool(void *mem, std::size_t size, bool create)
+	: hdr_( static_cast<Hdr *>( mem ) )
+	{
+		if ( reinterpret_cast<uintptr_t>( mem ) % ALIGN || size < HDR ) {
+			throw std::invalid_argument( "ShmPool: bad mapping" );
+		}
+		if ( create ) {
+			std::size_t n = ( size - HDR ) / sizeof(T);
+			if ( n >= NIL ) {
+				n = NIL - 1;
+			}
+			hdr_ = new ( mem ) Hdr { {0}, sizeof(T), uint32_t( n ), {NIL}, {0} };
+			for ( uint32_t i = n; i > 0; --i ) {
+				T *p       = new ( obj( hdr_, i - 1 ) ) T();
+				p->hdrOff_ = reinterpret_cast<char *>( p ) - reinterpret_cast<char *>( hdr_ );
+				p->idx_    = i - 1;
+				push( hdr_, p );
+			}
+			hdr_->magic_.store( MAGIC, std::memory_order_release );
+		} else {
+			if (    MAGIC     != hdr_->magic_.load( std::memory_order_acquire )
+			     || sizeof(T) != hdr_->objSize_
+			     || bytesFor( hdr_->nobjs_ ) > size ) {
+				throw std::invalid_argument( "ShmPool: incompatible pool" );
+			}
+		}
+	}
+
+	ShmPool(const ShmPool &)             = delete;
+	ShmPool & operator=(const ShmPool &) = delete;
+
+	// returns a null Shp if the pool is exhausted
+	Shp<T> get()
+	{
+		return Shp<T>( pop( hdr_ ) );
+	}
+
+	// transfer a reference out of this process; the returned
+	// handle is valid in every process attached to the pool.
+	uint32_t detach(Shp<T> &&p)
+	{
+		T *raw = p.detach();
+		return raw ? raw->idx_ : NIL;
+	}
+
+	// take over a reference passed by detach()
+	Shp<T> adopt(uint32_t handle)
+	{
+		if ( NIL == handle ) {
+			return Shp<T>();
+		}
+		if ( handle >= hdr_->nobjs_ ) {
+			throw std::out_of_range( "ShmPool: bad handle" );
+		}
+		return Shp<T>( obj( hdr_, handle ), ShpAdopt() );
+	}
+
+	// handle of an object (without transferring a reference)
+	uint32_t handle(const T *p) const
+	{
+		return p ? p->idx_ : NIL;
+	}
+
+	unsigned avail() const
+	{
+		return hdr_->avail_.load( std::memory_order_relaxed );
+	}
+
+	uint32_t capacity() const
+	{
+		return hdr_->nobjs_;
+	}
+};
+
+template <typename T>
+void
+ShmRelease<T>::release(T *p)
+{
+	using Hdr = typename ShmPool<T>::Hdr;
+	ShmPool<T>::push( reinterpret_cast<Hdr *>( reinterpret_cast<char *>( p ) - p->hdrOff_ ), p );
+}
+
+}; // namespace IntrusiveSmart
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+#include <IntrusiveShpFreeListSlab.hpp>
+
+// Size-class allocator for managed objects.
+//
+// Storage is handed out from a small number of size classes
+// (powers of two from 16 to 4096 bytes). Each class keeps a
+// free list of slots which are carved from slabs shared by
+// all types of compatible size and alignment. Requests which
+// are too large (or too strictly aligned) are forwarded to the
+// global operator new.
+//
+// Deriving from ShpSizeClassAllocated routes 'new' and 'delete'
+// of a type (and thus 'make_shp', ShpBase::unmanage() etc.) to
+// the allocator:
+//
+//   struct Msg : ShpBase, ShpSizeClassAllocated { ... };
+//
+// The class index is computed in constant time from the bit width
+// of the size (see 'classOf()'); it folds to a constant where the
+// size is known at compile time (e.g., 'sizeof(T)'). Every
+// allocation and deallocation takes the lock of its class (but
+// classes don't contend with each other).
+
+namespace IntrusiveSmart {
+
+class FreeListSizeClasses {
+public:
+	static constexpr unsigned    MIN_SHIFT   = 4;
+	static constexpr unsigned    MAX_SHIFT   = 12;
+	static constexpr unsigned    NUM_CLASSES = MAX_SHIFT - MIN_SHIFT + 1;
+	static constexpr std::size_t MAX_SIZE    = std::size_t(1) << MAX_SHIFT;
+	// slots are carved from cache-line aligned slabs; the alignment
+	// of a slot is thus min( slot size, cache line ).
+	static constexpr std::size_t MAX_ALIGN   = FreeListSlabArena::CACHELINE;
+	static constexpr std::size_t SLAB_SIZE   = 64*1024;
+
+	struct Stats {
+		// zero in the aggregate stats()
+		std::size_t slotSize_ {0};
+		// total number of slots (and bytes) carved from slabs
+		std::size_t slots_    {0};
+		std::size_t bytes_    {0};
+		std::size_t inUse_    {0};
+		std::size_t allocs_   {0};
+		std::size_t frees_    {0};
+		// requests forwarded to the global operator new
+		std::size_t fallback_ {0};
+	};
+
+	// number of bits needed to represent 'v' (C++20 std::bit_width)
+	static constexpr unsigned bitWidth(std::size_t v)
+	{
+#if defined(__GNUC__)
+		return v ? unsigned( 8*sizeof(unsigned long long) ) - unsigned( __builtin_clzll( v ) ) : 0;
+#else
+		unsigned w = 0;
+		while ( v ) {
+			++w;
+			v >>= 1;
+		}
+		return w;
+#endif
+	}
+
+	// size class for a request; NUM_CLASSES if the request
+	// cannot be handled by the size classes.
+	static constexpr unsigned classOf(std::size_t size, std::size_t align = alignof(std::max_align_t))
+	{
+		if ( align > MAX_ALIGN ) {
+			return NUM_CLASSES;
+		}
+		if ( size < align ) {
+			size = align;
+		}
+		if ( size > MAX_SIZE ) {
+			return NUM_CLASSES;
+		}
+		if ( size <= (std::size_t(1) << MIN_SHIFT) ) {
+			return 0;
+		}
+		// smallest power of two >= size
+		return bitWidth( size - 1 ) - MIN_SHIFT;
+	}
+
+private:
+	struct Slot {
+		Slot *next_;
+	};
+
+	struct alignas(FreeListSlabArena::CACHELINE) SizeClass {
+		std::mutex  mtx_;
+		Slot       *anchor_ {nullptr};
+		Stats       stats_;
+	};
+
+	SizeClass          classes_[NUM_CLASSES];
+	std::mutex         fallbackMtx_;
+	std::size_t        fallback_ {0};
+	// slab memory shared by all classes
+	std::mutex         arenaMtx_;
+	FreeListSlabArena  arena_;
+
+	// called with the class' lock held
+	void grow(unsigned cls)
+	{
+		SizeClass   &c    = classes_[cls];
+		std::size_t  sz   = std::size_t(1) << (cls + MIN_SHIFT);
+		std::size_t  n    = SLAB_SIZE / sz;
+		char        *mem;
+		{
+			std::unique_lock l( arenaMtx_ );
+			mem = static_cast<char*>( arena_.allocate( n * sz ) );
+		}
+		for ( std::size_t i = n; i > 0; --i ) {
+			auto s      = reinterpret_cast<Slot*>( mem + (i - 1)*sz );
+			s->next_    = c.anchor_;
+			c.anchor_   = s;
+		}
+		c.stats_.slots_ += n;
+		c.stats_.bytes_ += n * sz;
+	}
+
+public:
+	FreeListSizeClasses(bool hugePages = false)
+	: arena_( hugePages )
+	{
+		for ( unsigned i = 0; i < NUM_CLASSES; ++i ) {
+			classes_[i].stats_.slotSize_ = std::size_t(1) << (i + MIN_SHIFT);
+		}
+	}
+
+	FreeListSizeClasses(const FreeListSizeClasses &)             = delete;
+	FreeListSizeClasses & operator=(const FreeListSizeClasses &) = delete;
+
+	// the process-wide allocator; it is never destroyed so that
+	// objects may be released during static destruction.
+	static FreeListSizeClasses &instance()
+	{
+		static FreeListSizeClasses *theInstance = new FreeListSizeClasses();
+		return *theInstance;
+	}
+
+	void *allocate(std::size_t size, std::size_t align = alignof(std::max_align_t))
+	{
+		unsigned cls = classOf( size, align );
+		if ( cls >= NUM_CLASSES ) {
+			{
+				std::unique_lock l( fallbackMtx_ );
+				++fallback_;
+			}
+			return ::operator new( size, std::align_val_t( align ) );
+		}
+		SizeClass &c = classes_[cls];
+		std::unique_lock l( c.mtx_ );
+		if ( ! c.anchor_ ) {
+			grow( cls );
+		}
+		Slot *s   = c.anchor_;
+		c.anchor_ = s->next_;
+		++c.stats_.inUse_;
+		++c.stats_.allocs_;
+		return s;
+	}
+
+	// 'size' and 'align' must match the allocation
+	void deallocate(void *p, std::size_t size, std::size_t align = alignof(std::max_align_t))
+	{
+		if ( ! p ) {
+			return;
+		}
+		unsigned cls = classOf( size, align );
+		if ( cls >= NUM_CLASSES ) {
+			::operator delete( p, std::align_val_t( align ) );
+			return;
+		}
+		SizeClass &c = classes_[cls];
+		Slot      *s = static_cast<Slot*>( p );
+		std::unique_lock l( c.mtx_ );
+		s->next_  = c.anchor_;
+		c.anchor_ = s;
+		--c.stats_.inUse_;
+		++c.stats_.frees_;
+	}
+
+	template <typename T>
+	void *allocate()
+	{
+		return allocate( sizeof(T), alignof(T) );
+	}
+
+	template <typename T>
+	void deallocate(T *p)
+	{
+		deallocate( p, sizeof(T), alignof(T) );
+	}
+
+	constexpr unsigned numClasses() const
+	{
+		return NUM_CLASSES;
+	}
+
+	Stats stats(unsigned cls)
+	{
+		SizeClass &c = classes_[cls];
+		std::unique_lock l( c.mtx_ );
+		return c.stats_;
+	}
+
+	// aggregate over all classes
+	Stats stats()
+	{
+		Stats tot;
+		for ( unsigned i = 0; i < NUM_CLASSES; ++i ) {
+			Stats s = stats( i );
+			tot.slots_    += s.slots_;
+			tot.bytes_    += s.bytes_;
+			tot.inUse_    += s.inUse_;
+			tot.allocs_   += s.allocs_;
+			tot.frees_    += s.frees_;
+		}
+		std::unique_lock l( fallbackMtx_ );
+		tot.fallback_ = fallback_;
+		return tot;
+	}
+};
+
+// mix-in routing new/delete to FreeListSizeClasses::instance()
+struct ShpSizeClassAllocated {
+	static void *operator new(std::size_t size)
+	{
+		return FreeListSizeClasses::instance().allocate( size );
+	}
+
+	static void *operator new(std::size_t size, std::align_val_t align)
+	{
+		return FreeListSizeClasses::instance().allocate( size, std::size_t( align ) );
+	}
+
+	// sized deallocation; with a virtual destructor 'size' is
+	// the size of the complete object.
+	static void operator delete(void *p, std::size_t size)
+	{
+		FreeListSizeClasses::instance().deallocate( p, size );
+	}
+
+	static void operator delete(void *p, std::size_t size, std::align_val_t align)
+	{
+		FreeListSizeClasses::instance().deallocate( p, size, std::size_t( align ) );
+	}
+};
+
+}; // namespace IntrusiveSmart
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+
+#include <IntrusiveShp.hpp>
+
+// Intrusive weak references for recycled (pooled) objects.
+//
+// A WeakShp does not keep its object alive. Weak support is
+// opt-in: derive from ShpWeakBase<Base> where 'Base' is the
+// control block otherwise used (ShpBase, FreeListNode, ...),
+// e.g.,
+//
+//   struct Entry : ShpWeakBase<FreeListNode> { ... };
+//
+// ShpWeakBase adds a generation number which is incremented
+// whenever the last strong reference is dropped (i.e., before
+// the object is unmanaged, recycled and possibly handed out
+// anew). A WeakShp records the generation and lock() fails if
+// it has changed; a weak reference thus never resurrects a
+// recycled object.
+//
+// NOTE: weak references do not keep the object's storage
+//       alive; the objects must be managed by a free list
+//       (or similar) which outlives all weak references.
+//       All strong references must be Shp's of the weak-enabled
+//       type (or types derived from it); otherwise the generation
+//       is not updated.
+
+namespace IntrusiveSmart {
+
+template <typename T> class WeakShp;
+
+template <typename Base = ShpBase>
+class ShpWeakBase : public Base {
+	friend struct ShpWeakCount;
+	template <typename T> friend class WeakShp;
+private:
+	mutable std::atomic<uint32_t> gen_{0};
+
+public:
+	typedef ShpWeakBase  ShpWeakControlBlock;
+	typedef ShpWeakCount ShpCountPolicy;
+
+	using Base::Base;
+};
+
+// Count policy for weak-enabled objects; like ShpAtomicCount
+// but
+//  - increments have release semantics so that a thread which
+//    upgrades a weak reference observes the generation of the
+//    object's current incarnation.
+//  - the generation is incremented before the object is
+//    unmanaged.
+struct ShpWeakCount {
+	template <typename T>
+	static void incRef(const T *p, unsigned n = 1)
+	{
+		auto &c = shpControlBlock( p )->refcnt_;
+		c.fetch_add( decltype( c.load() )( n ), std::memory_order_release );
+	}
+
+	template <typename T>
+	static void decRef(const T *p, unsigned n = 1)
+	{
+		auto  b = shpControlBlock( p );
+		auto &c = b->refcnt_;
+		if ( decltype( c.load() )( n ) == c.fetch_sub( decltype( c.load() )( n ), std::memory_order_release ) ) {
+#ifdef SHP_TSAN
+			c.load( std::memory_order_acquire );
+#else
+			std::atomic_thread_fence( std::memory_order_acquire );
+#endif
+			auto &g = static_cast<const typename T::ShpWeakControlBlock *>( p )->gen_;
+			g.store( g.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+			b->release();
+		}
+	}
+
+	// increment unless the count is zero
+	template <typename T>
+	static bool tryIncRef(const T *p)
+	{
+		auto &c = shpControlBlock( p )->refcnt_;
+		auto  v = c.load( std::memory_order_relaxed );
+		do {
+			if ( 0 == v ) {
+				return false;
+			}
+		} while ( ! c.compare_exchange_weak( v, v + 1,
+		                                     std::memory_order_acquire,
+		                                     std::memory_order_relaxed ) );
+		return true;
+	}
+};
+
+template <typename T>
+class WeakShp {
+	template <typename U> friend class WeakShp;
+private:
+	T        *p_;
+	uint32_t  gen_;
+
+	static uint32_t gen(const T *p)
+	{
+		return static_cast<const typename T::ShpWeakControlBlock *>( p )->gen_.load( std::memory_order_relaxed );
+	}
+
+public:
+	WeakShp()
+	: p_  ( nullptr ),
+	  gen_( 0       )
+	{
+	}
+
+	template <typename U>
+	WeakShp(const Shp<U> &rhs)
+	: p_  ( rhs.get()               ),
+	  gen_( p_ ? gen( p_ ) : 0 )
+	{
+	}
+
+	template <typename U>
+	WeakShp(const WeakShp<U> &rhs)
+	: p_  ( rhs.p_   ),
+	  gen_( rhs.gen_ )
+	{
+	}
+
+	// obtain a strong reference; returns a null Shp if the
+	// object has been released (and possibly recycled).
+	Shp<T> lock() const
+	{
+		if ( ! p_ || ! ShpWeakCount::tryIncRef( p_ ) ) {
+			return Shp<T>();
+		}
+		// we hold a reference, i.e., the generation is stable
+		Shp<T> rv( p_, ShpAdopt() );
+		if ( gen( p_ ) != gen_ ) {
+			rv.reset();
+		}
+		return rv;
+	}
+
+	bool expired() const
+	{
+		return ! p_ || 0 == p_->use_count() || gen( p_ ) != gen_;
+	}
+
+	void reset()
+	{
+		p_   = nullptr;
+		gen_ = 0;
+	}
+
+	// the referenced address (which may be stale)
+	T *get() const
+	{
+		return p_;
+	}
+};
+
+}; // namespace IntrusiveSmart
@@ -0,0 +1,491 @@
+// Micro-benchmarks: Shp vs. std::shared_ptr vs. boost::intrusive_ptr
+// and pooled (free list) vs. new/delete allocation.
+//
+// There is no build system; compile e.g. with
+//
+//   g++ -std=c++17 -O2 -march=native -I.. -o ShpBench ShpBench.cpp ../IntrusiveShpFreeList.cpp -latomic -pthread
+//
+// boost::intrusive_ptr is included if the boost headers are found.
+//
+// Usage: ShpBench [max_threads [iterations]]
+//
+// Every benchmark is executed with 1, 2, 4, ... threads up to
+// 'max_threads' (default: all cores). Each thread performs
+// 'iterations' operations; the results are per operation and
+// thread: wall-clock time and - if linux perf counters are
+// accessible (see /proc/sys/kernel/perf_event_paranoid) - CPU
+// cycles and last-level cache misses.
+//
+// The copy/count/move/compare benchmarks operate on an object shared
+// by all threads (i.e., they measure contention on the count);
+// the allocation benchmarks use a single list shared by all
+// threads.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if __has_include(<boost/intrusive_ptr.hpp>)
+#include <boost/intrusive_ptr.hpp>
+#define SHP_BENCH_BOOST 1
+#endif
+
+#include <IntrusiveShp.hpp>
+#include <IntrusiveShpFreeList.hpp>
+#include <IntrusiveShpFreeListLockFree.hpp>
+#include <IntrusiveShpFreeListArray.hpp>
+#include <IntrusiveShpFreeListMagazine.hpp>
+
+using namespace IntrusiveSmart;
+
+// keep the compiler from optimizing 'v' away
+template <typename V>
+static inline void keep(V &v)
+{
+#if defined(__GNUC__)
+	asm volatile( "" : : "r,m"( v ) : "memory" );
+#else
+	static volatile const void *sink;
+	sink = &v;
+#endif
+}
+
+// per-thread hardware counters
+class PerfCounters {
+public:
+	struct Values {
+		uint64_t cycles_ {0};
+		uint64_t misses_ {0};
+	};
+
+private:
+	int fd_[2] {-1, -1};
+
+#ifdef __linux__
+	static int open(uint64_t config)
+	{
+		struct perf_event_attr a;
+		memset( &a, 0, sizeof(a) );
+		a.type           = PERF_TYPE_HARDWARE;
+		a.size           = sizeof(a);
+		a.config         = config;
+		a.disabled       = 1;
+		a.exclude_kernel = 1;
+		a.exclude_hv     = 1;
+		return syscall( SYS_perf_event_open, &a, 0, -1, -1, 0 );
+	}
+
+	static uint64_t read(int fd)
+	{
+		uint64_t v = 0;
+		if ( fd >= 0 && sizeof(v) != ::read( fd, &v, sizeof(v) ) ) {
+			v = 0;
+		}
+		return v;
+	}
+#endif
+
+public:
+	PerfCounters()
+	{
+#ifdef __linux__
+		fd_[0] = open( PERF_COUNT_HW_CPU_CYCLES );
+		fd_[1] = open( PERF_COUNT_HW_CACHE_MISSES );
+#endif
+	}
+
+	PerfCounters(const PerfCounters &)             = delete;
+	PerfCounters & operator=(const PerfCounters &) = delete;
+
+	bool valid() const
+	{
+		return fd_[0] >= 0;
+	}
+
+	void start()
+	{
+#ifdef __linux__
+		for ( auto fd : fd_ ) {
+			if ( fd >= 0 ) {
+				ioctl( fd, PERF_EVENT_IOC_RESET,  0 );
+				ioctl( fd, PERF_EVENT_IOC_ENABLE, 0 );
+			}
+		}
+#endif
+	}
+
+	Values stop()
+	{
+		Values v;
+#ifdef __linux__
+		for ( auto fd : fd_ ) {
+			if ( fd >= 0 ) {
+				ioctl( fd, PERF_EVENT_IOC_DISABLE, 0 );
+			}
+		}
+		v.cycles_ = read( fd_[0] );
+		v.misses_ = read( fd_[1] );
+#endif
+		return v;
+	}
+
+	~PerfCounters()
+	{
+#ifdef __linux__
+		for ( auto fd : fd_ ) {
+			if ( fd >= 0 ) {
+				close( fd );
+			}
+		}
+#endif
+	}
+};
+
+static unsigned long iterations = 1000000;
+
+// Run 'body(iterations)' in 'nthreads' threads and print the results
+template <typename F>
+static void run(const char *name, unsigned nthreads, F body)
+{
+	std::atomic<unsigned>             ready {0};
+	std::atomic<bool>                 go    {false};
+	std::vector<double>               ns    ( nthreads );
+	std::vector<PerfCounters::Values> vals  ( nthreads );
+	std::atomic<bool>                 perf  {true};
+	std::vector<std::thread>          threads;
+
+	for ( unsigned i = 0; i < nthreads; ++i ) {
+		threads.emplace_back( [&, i] {
+			PerfCounters pc;
+			if ( ! pc.valid() ) {
+				perf.store( false );
+			}
+			ready.fetch_add( 1 );
+			while ( ! go.load( std::memory_order_acquire ) ) {
+				std::this_thread::yield();
+			}
+			auto then = std::chrono::steady_clock::now();
+			pc.start();
+			body( iterations );
+			vals[i] = pc.stop();
+			ns[i]   = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - then ).count();
+		} );
+	}
+	while ( ready.load() < nthreads ) {
+		std::this_thread::yield();
+	}
+	go.store( true, std::memory_order_release );
+	for ( auto &t : threads ) {
+		t.join();
+	}
+
+	double tns = 0, cyc = 0, mis = 0;
+	for ( unsigned i = 0; i < nthreads; ++i ) {
+		tns += ns[i];
+		cyc += vals[i].cycles_;
+		mis += vals[i].misses_;
+	}
+	double ops = double( iterations ) * nthreads;
+	printf( "%-36s %3u thr %9.2f ns/op", name, nthreads, tns / ops );
+	if ( perf.load() ) {
+		printf( " %9.2f cyc/op %7.3f miss/op", cyc / ops, mis / ops );
+	}
+	printf( "\n" );
+}
+
+// managed test objects
+struct ShpObj : ShpBase {
+	int v_ {0};
+};
+
+// user data on the control block's cache line
+struct HotObj : ShpBase {
+	int v_ {0};
+};
+
+// user data isolated from the control block
+struct PaddedObj : ShpPaddedBase<> {
+	int v_ {0};
+};
+
+struct PlainObj {
+	int v_ {0};
+};
+
+struct PoolObj : FreeListNode {
+	int v_ {0};
+};
+
+#ifdef SHP_BENCH_BOOST
+struct BoostObj {
+	mutable std::atomic<int> cnt_ {0};
+	int                      v_   {0};
+};
+
+static void intrusive_ptr_add_ref(const BoostObj *p)
+{
+	p->cnt_.fetch_add( 1, std::memory_order_relaxed );
+}
+
+static void intrusive_ptr_release(const BoostObj *p)
+{
+	if ( 1 == p->cnt_.fetch_sub( 1, std::memory_order_acq_rel ) ) {
+		delete p;
+	}
+}
+#endif
+
+// copy and destroy a pointer to a (shared) object
+template <typename P>
+static void copyBench(const char *name, unsigned nthreads, const P &master)
+{
+	run( name, nthreads, [&master](unsigned long n) {
+		for ( unsigned long i = 0; i < n; ++i ) {
+			P p( master );
+			keep( p );
+		}
+	} );
+}
+
+// The count updates performed by copying and dropping a reference:
+// the orderings used by ShpAtomicCount (relaxed increment, release
+// decrement) vs. sequentially consistent ones. On x86 both compile
+// to the same locked instructions; weakly ordered machines (e.g.,
+// ARM) benefit from the relaxed/release scheme.
+template <std::memory_order INC, std::memory_order DEC>
+static void countBench(const char *name, unsigned nthreads)
+{
+	struct alignas(SHP_CACHELINE_SIZE) Count {
+		std::atomic<int> c_ {1};
+	};
+	Count cnt;
+	run( name, nthreads, [&cnt](unsigned long n) {
+		for ( unsigned long i = 0; i < n; ++i ) {
+			cnt.c_.fetch_add( 1, INC );
+			if ( 1 == cnt.c_.fetch_sub( 1, DEC ) ) {
+				// never reached; the count starts at one
+				std::atomic_thread_fence( std::memory_order_acquire );
+				abort();
+			}
+		}
+	} );
+}
+
+// move a pointer back and forth
+template <typename P>
+static void moveBench(const char *name, unsigned nthreads, const P &master)
+{
+	run( name, nthreads, [&master](unsigned long n) {
+		P a( master );
+		P b;
+		for ( unsigned long i = 0; i < n; ++i ) {
+			b = std::move( a );
+			keep( b );
+			a = std::move( b );
+			keep( a );
+		}
+	} );
+}
+
+// reset a copy of a (shared) object
+template <typename P>
+static void resetBench(const char *name, unsigned nthreads, const P &master)
+{
+	run( name, nthreads, [&master](unsigned long n) {
+		P p;
+		for ( unsigned long i = 0; i < n; ++i ) {
+			p = master;
+			p.reset();
+			keep( p );
+		}
+	} );
+}
+
+template <typename P>
+static void compareBench(const char *name, unsigned nthreads, const P &master)
+{
+	run( name, nthreads, [&master](unsigned long n) {
+		P   a( master );
+		P   b( master );
+		int eq = 0;
+		for ( unsigned long i = 0; i < n; ++i ) {
+			keep( a );
+			eq += ( a == b );
+		}
+		keep( eq );
+	} );
+}
+
+// one thread keeps writing to the object while all others
+// copy and destroy references to it (false sharing between
+// the user data and the reference count).
+template <typename T>
+static void falseSharingBench(const char *name, unsigned nthreads)
+{
+	Shp<T>                master( new T() );
+	std::atomic<unsigned> idx { 0 };
+	run( name, nthreads, [&master, &idx](unsigned long n) {
+		if ( 0 == idx.fetch_add( 1 ) ) {
+			T *o = master.get();
+			for ( unsigned long i = 0; i < n; ++i ) {
+				o->v_ = i;
+				keep( o->v_ );
+			}
+		} else {
+			for ( unsigned long i = 0; i < n; ++i ) {
+				Shp<T> p( master );
+				keep( p );
+			}
+		}
+	} );
+}
+
+// obtain and release an object
+template <typename F>
+static void allocBench(const char *name, unsigned nthreads, F make)
+{
+	run( name, nthreads, [&make](unsigned long n) {
+		for ( unsigned long i = 0; i < n; ++i ) {
+			auto p = make();
+			keep( p );
+		}
+	} );
+}
+
+template <typename L>
+static void prefill(L &l, unsigned n)
+{
+	for ( unsigned i = 0; i < n; ++i ) {
+		l.put( new PoolObj() );
+	}
+}
+
+// prefill the depot of a magazine list (objects put by the main
+// thread would remain in the main thread's magazine); the worker
+// threads' magazines are refilled from the depot.
+template <typename L>
+static void prefillDepot(L &l, unsigned n)
+{
+	FreeListBase  tmp;
+	FreeListNode *head, *tail;
+	prefill( tmp, n );
+	unsigned cnt = tmp.getChain( &head, &tail, n );
+	l.putChain( head, tail, cnt );
+}
+
+// the numbers of threads to run: 1, 2, 4, ... maxThreads
+static std::vector<unsigned> threadCounts(unsigned maxThreads)
+{
+	std::vector<unsigned> v;
+	for ( unsigned nthreads = 1; nthreads < maxThreads; nthreads *= 2 ) {
+		v.push_back( nthreads );
+	}
+	v.push_back( maxThreads );
+	return v;
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned maxThreads = std::thread::hardware_concurrency();
+	if ( argc > 1 ) {
+		maxThreads = strtoul( argv[1], nullptr, 0 );
+	}
+	if ( argc > 2 ) {
+		iterations = strtoul( argv[2], nullptr, 0 );
+	}
+	if ( 0 == maxThreads ) {
+		maxThreads = 1;
+	}
+
+	Shp<ShpObj>               shp ( new ShpObj() );
+	std::shared_ptr<PlainObj> sp  ( std::make_shared<PlainObj>() );
+#ifdef SHP_BENCH_BOOST
+	boost::intrusive_ptr<BoostObj> bip( new BoostObj() );
+#endif
+
+	const auto counts = threadCounts( maxThreads );
+
+	FreeListBase       mtxList;
+	FreeListLockFree   lfList;
+	FreeListMagazine<> magList;
+	// large enough for the prefills below ('nthreads' per round)
+	FreeListArray      arrList( std::accumulate( counts.begin(), counts.end(), 0U ) );
+
+	for ( unsigned nthreads : counts ) {
+		copyBench   ( "copy    Shp",            nthreads, shp );
+		copyBench   ( "copy    shared_ptr",     nthreads, sp  );
+#ifdef SHP_BENCH_BOOST
+		copyBench   ( "copy    intrusive_ptr",  nthreads, bip );
+#endif
+		countBench<std::memory_order_relaxed, std::memory_order_release>( "count   relaxed/release", nthreads );
+		countBench<std::memory_order_seq_cst, std::memory_order_seq_cst>( "count   seq_cst",         nthreads );
+		moveBench   ( "move    Shp",            nthreads, shp );
+		moveBench   ( "move    shared_ptr",     nthreads, sp  );
+#ifdef SHP_BENCH_BOOST
+		moveBench   ( "move    intrusive_ptr",  nthreads, bip );
+#endif
+		resetBench  ( "reset   Shp",            nthreads, shp );
+		resetBench  ( "reset   shared_ptr",     nthreads, sp  );
+#ifdef SHP_BENCH_BOOST
+		resetBench  ( "reset   intrusive_ptr",  nthreads, bip );
+#endif
+		compareBench( "compare Shp",            nthreads, shp );
+		compareBench( "compare shared_ptr",     nthreads, sp  );
+#ifdef SHP_BENCH_BOOST
+		compareBench( "compare intrusive_ptr",  nthreads, bip );
+#endif
+
+		falseSharingBench<HotObj>   ( "write+copy Shp (shared line)", nthreads );
+		falseSharingBench<PaddedObj>( "write+copy Shp (padded)",      nthreads );
+
+		allocBench( "alloc   new/delete", nthreads, [] {
+			return std::unique_ptr<PlainObj>( new PlainObj() );
+		} );
+		allocBench( "alloc   make_shared", nthreads, [] {
+			return std::make_shared<PlainObj>();
+		} );
+		allocBench( "alloc   make_shp", nthreads, [] {
+			return make_shp<ShpObj>();
+		} );
+#ifdef SHP_BENCH_BOOST
+		allocBench( "alloc   intrusive_ptr", nthreads, [] {
+			return boost::intrusive_ptr<BoostObj>( new BoostObj() );
+		} );
+#endif
+
+		// keep enough objects on the lists so that 'get' never fails
+		prefill( mtxList, nthreads );
+		prefill( lfList,  nthreads );
+		prefill( arrList, nthreads );
+		prefillDepot( magList, nthreads * ( 2 * magList.magazineSize() + 1 ) );
+
+		allocBench( "get/put FreeListBase", nthreads, [&mtxList] {
+			return mtxList.get<PoolObj>();
+		} );
+		allocBench( "get/put FreeListLockFree", nthreads, [&lfList] {
+			return lfList.get<PoolObj>();
+		} );
+		allocBench( "get/put FreeListArray", nthreads, [&arrList] {
+			return arrList.get<PoolObj>();
+		} );
+		allocBench( "get/put FreeListMagazine", nthreads, [&magList] {
+			return magList.get<PoolObj>();
+		} );
+	}
+	return 0;
+}
@@ -0,0 +1,120 @@
+// Verify that FreeListArray can be used under each of the layering
+// templates (which pass the capacity on to their base) and that
+// objects circulate through the array.
+//
+// There is no build system; compile and run e.g. with
+//
+//   g++ -std=c++17 -O2 -Wall -I.. -o FreeListArrayTest FreeListArrayTest.cpp ../IntrusiveShpFreeList.cpp -latomic -pthread && ./FreeListArrayTest
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <IntrusiveShpFreeListArray.hpp>
+#include <IntrusiveShpFreeListDeferred.hpp>
+#include <IntrusiveShpFreeListMagazine.hpp>
+#include <IntrusiveShpFreeListPool.hpp>
+#include <IntrusiveShpFreeListSlab.hpp>
+
+using namespace IntrusiveSmart;
+
+#define CHECK( cond ) \
+	do { \
+		if ( ! ( cond ) ) { \
+			fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond ); \
+			exit( 1 ); \
+		} \
+	} while ( 0 )
+
+struct Obj : FreeListNode {
+	int v_ {0};
+};
+
+static const unsigned CAP = 16;
+
+static void
+testMagazine()
+{
+	FreeListMagazine<FreeListArray> l( 4, true, CAP );
+	CHECK( l.capacity() == CAP );
+	Shp<Obj> ps[ CAP ];
+	// the list is empty; make() creates the objects
+	for ( unsigned i = 0; i < CAP; ++i ) {
+		ps[i] = l.make<Obj>();
+		CHECK( ps[i] );
+		ps[i]->v_ = i;
+	}
+	for ( unsigned i = 0; i < CAP; ++i ) {
+		ps[i].reset();
+	}
+	l.flush();
+	CHECK( l.avail() == CAP );
+	for ( unsigned i = 0; i < CAP; ++i ) {
+		ps[i] = l.make<Obj>();
+		CHECK( ps[i] );
+	}
+	CHECK( l.avail() == 0 );
+}
+
+static void
+testPool()
+{
+	FreeListPool<Obj, FreeListArray> pool( []() { return new Obj(); }, CAP, 1, ~0U, true, CAP );
+	CHECK( pool.capacity() == CAP );
+	CHECK( pool.avail() == CAP );
+	{
+		Shp<Obj> ps[ CAP ];
+		for ( unsigned i = 0; i < CAP; ++i ) {
+			ps[i] = pool.get();
+			CHECK( ps[i] );
+		}
+		CHECK( pool.avail() == 0 );
+	}
+	CHECK( pool.avail() == CAP );
+}
+
+static void
+testSlabPool()
+{
+	FreeListSlabPool<Obj, FreeListArray> pool( CAP, 1, false, [](void *mem) { return new ( mem ) Obj(); }, -1, CAP );
+	CHECK( pool.capacity() == CAP );
+	CHECK( pool.avail() == CAP );
+	{
+		Shp<Obj> ps[ CAP ];
+		for ( unsigned i = 0; i < CAP; ++i ) {
+			ps[i] = pool.get();
+			CHECK( ps[i] );
+		}
+		CHECK( pool.avail() == 0 );
+	}
+	CHECK( pool.avail() == CAP );
+	CHECK( pool.numSlabs() == 1 );
+}
+
+static void
+testDeferred()
+{
+	FreeListDeferred<FreeListArray> l( FreeListDeferred<FreeListArray>::Reset(), std::chrono::milliseconds( 0 ), CAP );
+	CHECK( l.capacity() == CAP );
+	Obj *p;
+	{
+		auto s = l.make<Obj>();
+		p = s.get();
+	}
+	// retired but not yet reclaimed
+	CHECK( l.avail() == 0 );
+	l.flush();
+	CHECK( l.avail() == 1 );
+	auto s = l.make<Obj>();
+	CHECK( s.get() == p );
+}
+
+int
+main()
+{
+	testMagazine();
+	testPool();
+	testSlabPool();
+	testDeferred();
+	printf( "FreeListArrayTest: OK\n" );
+	return 0;
+}
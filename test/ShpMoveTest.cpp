@@ -0,0 +1,145 @@
+// Verify that moving Shp's (construction, assignment, swap, and
+// the element moves performed by std::vector when it reallocates)
+// never touches the reference count.
+//
+// The objects use a counting policy which delegates to ShpAtomicCount
+// and records every increment and decrement.
+//
+// There is no build system; compile and run e.g. with
+//
+//   g++ -std=c++17 -O2 -Wall -I.. -o ShpMoveTest ShpMoveTest.cpp && ./ShpMoveTest
+
+#include <cstdio>
+#include <cstdlib>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <IntrusiveShp.hpp>
+
+using namespace IntrusiveSmart;
+
+#define CHECK( cond ) \
+	do { \
+		if ( ! ( cond ) ) { \
+			fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond ); \
+			exit( 1 ); \
+		} \
+	} while ( 0 )
+
+static unsigned long incs = 0;
+static unsigned long decs = 0;
+
+struct CountingPolicy {
+	template <typename T>
+	static void incRef(const T *p)
+	{
+		++incs;
+		ShpAtomicCount::incRef( p );
+	}
+
+	template <typename T>
+	static void decRef(const T *p)
+	{
+		++decs;
+		ShpAtomicCount::decRef( p );
+	}
+};
+
+static unsigned long live = 0;
+
+struct Obj : ShpBase {
+	typedef CountingPolicy ShpCountPolicy;
+
+	Obj()
+	{
+		++live;
+	}
+
+	virtual ~Obj()
+	{
+		--live;
+	}
+};
+
+struct Derived : Obj {
+};
+
+static_assert( std::is_nothrow_move_constructible< Shp<Obj> >::value, "move construction must be noexcept" );
+static_assert( std::is_nothrow_move_assignable< Shp<Obj> >::value,    "move assignment must be noexcept" );
+static_assert( noexcept( std::declval< Shp<Obj>& >().swap( std::declval< Shp<Obj>& >() ) ), "swap must be noexcept" );
+
+static void resetCounts()
+{
+	incs = decs = 0;
+}
+
+static void checkNoCounting(const char *what)
+{
+	if ( incs || decs ) {
+		fprintf( stderr, "%s: %lu increments, %lu decrements\n", what, incs, decs );
+		exit( 1 );
+	}
+}
+
+int
+main()
+{
+	const unsigned N = 100;
+
+	{
+		Shp<Obj> a( new Obj() );
+		CHECK( 1 == incs );
+
+		resetCounts();
+		Shp<Obj> b( std::move( a ) );
+		CHECK( ! a && b );
+		a = std::move( b );
+		CHECK( a && ! b );
+		a.swap( b );
+		CHECK( ! a && b );
+		std::swap( a, b );
+		CHECK( a && ! b );
+		// self-move keeps the reference
+		Shp<Obj> &r = a;
+		a = std::move( r );
+		CHECK( 1 == a.use_count() );
+		checkNoCounting( "move/swap" );
+
+		// converting moves
+		Shp<Derived> d( new Derived() );
+		resetCounts();
+		Shp<Obj> o( std::move( d ) );
+		d = static_shp_cast<Derived>( std::move( o ) );
+		o = std::move( d );
+		CHECK( o && ! d && 1 == o.use_count() );
+		checkNoCounting( "converting move" );
+	}
+	CHECK( 0 == live );
+
+	{
+		std::vector< Shp<Obj> > v;
+		for ( unsigned i = 0; i < N; ++i ) {
+			v.emplace_back( new Obj() );
+		}
+
+		resetCounts();
+		// reallocation moves the elements
+		v.reserve( 4 * v.capacity() );
+		v.shrink_to_fit();
+		v.insert( v.begin(), Shp<Obj>() );
+		v.erase( v.begin() );
+		std::vector< Shp<Obj> > w( std::move( v ) );
+		v = std::move( w );
+		checkNoCounting( "vector reallocation" );
+
+		CHECK( N == v.size() );
+		for ( auto &p : v ) {
+			CHECK( 1 == p.use_count() );
+		}
+	}
+	CHECK( 0 == live );
+
+	printf( "ShpMoveTest: OK\n" );
+	return 0;
+}